@@ -1,14 +1,23 @@
 #ifndef __COOMER_H__
 #define __COOMER_H__
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+// timer queries are not in the GLES3 header
+#define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
 #include <GL/glx.h>
 #include <GLES3/gl3.h>
+#include <pthread.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
 #include <X11/extensions/Xrandr.h>
+#include <X11/extensions/shape.h>
 #include <X11/keysym.h>
 
 #include "util.h"
@@ -25,13 +34,33 @@
         return_defer(RET);                      \
     }
 
-#define OPTIONS_ARGS_DEFAULT ((options_args){.windowed = false, .delay_second = 0, .new_config = NULL, .config = NULL})
+typedef enum {
+    COOM_VSYNC_ON,
+    COOM_VSYNC_OFF,
+    COOM_VSYNC_ADAPTIVE,  // tear instead of waiting a whole vblank when a frame is late
+} coom_vsync;
+
+typedef enum {
+    COOM_RENDERER_GL,
+    COOM_RENDERER_SOFT,  // no GL at all, for indirect GLX and slow software GL at high resolutions
+} coom_renderer;
+
+#define OPTIONS_ARGS_DEFAULT                                                                                                                 \
+    ((options_args){.windowed = false, .live = false, .delay_second = 0, .vsync = COOM_VSYNC_ON, .renderer = COOM_RENDERER_GL, .monitor = NULL, \
+                    .loupe = 0, .new_config = NULL, .config = NULL})
 typedef struct {
-    bool        windowed;
-    bool        select;
-    f32         delay_second;
-    const char *new_config;
-    const char *config;
+    bool          windowed;
+    bool          select;
+    bool          region;
+    bool          live;
+    f32           delay_second;
+    coom_vsync    vsync;
+    coom_renderer renderer;
+    int           loupe;
+    const char   *monitor;
+    const char   *bench;
+    const char   *new_config;
+    const char   *config;
 } options_args;
 
 bool parse_args(int *argc, char ***argv, options_args *optargs);
@@ -39,17 +68,34 @@ bool parse_args(int *argc, char ***argv, options_args *optargs);
 ///////////////////////////////////////////////////////////////////////
 /// CONFIG
 ///////////////////////////////////////////////////////////////////////
+// how magnified texels are reconstructed, minification always goes through the mipmapped sampler
+typedef enum {
+    COOM_FILTER_NEAREST,
+    COOM_FILTER_BICUBIC,
+    COOM_FILTER_LANCZOS2,
+    COOM_FILTER_LANCZOS3,
+    COOM_FILTER_COUNT,
+} coom_filter;
+const char *coom_filter_name(coom_filter filter);
+
 typedef struct {
-    float min_scale;
-    float scroll_speed;
-    float drag_friction;
-    float scale_friction;
+    float       min_scale;
+    float       scroll_speed;
+    float       drag_friction;
+    float       scale_friction;
+    float       history_budget;
+    coom_filter filter;
+    float       grid_scale;    // texel grid from this zoom on, 0 never
+    float       inspect_size;  // side of the square averaged by the pixel inspector
+    float       png_level;     // zlib level of saved PNGs, 0 stores, 9 is the smallest
+    float       export_scale;  // output pixels per window pixel of an exported view
 } coom_config_t;
 float parse_float(const char *str, float dflt);
 // return null on error
 coom_config_t *coom_load_config(const char *file_path);
 void           coom_unload_config(coom_config_t *cfg);
 bool           coom_generate_default_config(const char *file_path);
+extern const coom_config_t default_config;
 
 const char    *get_config_path(const char *dir, const char *file);
 
@@ -57,6 +103,15 @@ const char    *get_config_path(const char *dir, const char *file);
 /// coomer objects
 ///////////////////////////////////////////////////////////////////////
 #define VELOCITY_THRESHOLD 10.0
+#define COOM_DEFAULT_RATE  60
+// longest step fed to the camera physics, a stalled frame must not fling the camera away
+#define COOM_MAX_DT        0.1
+typedef struct {
+    int x, y;
+    int w, h;
+} coom_rect;
+#define coom_rect_bytes(r, bpp) ((usize)(r).w * (r).h * ((bpp) / 8))
+
 typedef struct {
     bool enabled;
     f32  shadow;
@@ -78,24 +133,258 @@ typedef struct {
     f32    deltascale;
 } coom_camera;
 
+#define COOM_HISTORY_MAX_FRAMES 1024
+typedef struct {
+    coom_rect rect;  // changed part of the capture
+    usize     offset;
+    usize     size;
+} coom_history_frame;
+
+// bounded ring of past live captures, see history.c
+typedef struct {
+    u8                *arena;
+    usize              capacity;
+    usize              head;
+    coom_history_frame frames[COOM_HISTORY_MAX_FRAMES];
+    usize              first, count;
+    usize              cursor;  // frames behind the live capture, 0 while live
+    bool               resync;  // the texture has to be refreshed from the live capture
+    XImage            *view;    // what the texture shows while scrubbing
+    coom_rect          pending;
+    u32               *scratch, *encoded;
+    usize              scratch_cap;
+} coom_history;
+
+typedef struct {
+    Damage       damage;
+    int          event_base;
+    bool         pending;
+    coom_history history;
+} coom_live;
+
+// upper bound of a tile side, smaller when GL_MAX_TEXTURE_SIZE says so
+#define COOM_TILE_SIZE 2048
+typedef struct {
+    GLuint    id;
+    coom_rect rect;  // part of the capture held by this tile
+    GLint     min_filter;
+    bool      mipmapped;  // mip chain is built and matches level 0
+} coom_tile;
+
+// the capture split into tiles, so it fits any GL_MAX_TEXTURE_SIZE and off-screen parts are skipped
+typedef struct {
+    coom_tile *tiles;
+    usize      count;
+    int        width, height;
+    int        tile_size;
+    GLfloat    anisotropy;     // max supported, 0 without EXT_texture_filter_anisotropic
+    GLenum     internal_format, format, type;  // picked from the XImage so the driver can copy as is
+    bool       client_upload;  // skip the PBOs and upload straight from client memory
+    GLuint     pbo[2];         // alternated, so filling one never waits on the transfer of the other
+    usize      pbo_size[2];
+    int        pbo_next;
+} coom_texture;
+
+// a small round window that follows the pointer and only draws the magnified patch under it
+#define COOM_LOUPE_SCALE 4.0
+typedef struct {
+    int    size;     // diameter, 0 without --loupe
+    vec2_t pointer;  // root coordinates
+    vec2_t origin;   // root position of the capture's top left corner
+    bool   moved;
+} coom_loupe;
+
+// small text window in the top left corner of the zoom window, see overlay.c
+#define COOM_OVERLAY_LINES 2
+enum { COOM_OVERLAY_INSPECTOR, COOM_OVERLAY_EXPORT };
+typedef struct {
+    Window       win;
+    GC           gc;
+    XFontStruct *font;
+    int          ascent, descent;
+    int          columns;  // of the widest line
+} coom_overlay;
+
+// hovered pixel read from the capture in memory, nothing is read back from the GPU
+typedef struct {
+    bool         enabled;
+    bool         stale;    // the overlay shows an older pixel or camera
+    coom_overlay overlay;  // created on the first toggle
+    bool         inside;   // the pointer is over the capture
+    int          x, y;     // hovered capture pixel
+    int          size;     // of the averaged square, odd
+    u32          rgb;      // 0xRRGGBB of the pixel and of the square around it
+    u32          average;
+} coom_inspector;
+
+typedef struct coom_clipboard_image    coom_clipboard_image;
+typedef struct coom_clipboard_transfer coom_clipboard_transfer;
+
+// CLIPBOARD selection owned by the zoom window, served from the event loop. text and image are
+// NULL while someone else owns the selection, at most one of them is set
+typedef struct {
+    Atom                     clipboard, targets, utf8, png, ppm, incr;
+    char                    *text;
+    coom_clipboard_image    *image;
+    int                      level;      // zlib level of image/png
+    usize                    chunk;      // largest property we write, bigger payloads go through INCR
+    coom_clipboard_transfer *transfers;  // INCR transfers waiting for the requestor
+} coom_clipboard;
+
+// what to write, everything the worker needs is copied in so the camera can keep moving
+typedef struct {
+    char        path[64];
+    int         level;  // zlib level
+    bool        view;   // only what the window showed, see coom_export_view
+    coom_camera cam;
+    vec2_t      winsize;
+    f32         scale;
+} coom_export_request;
+
+// capture pixels exports read from, one reference per queued export and one for the cache
+typedef struct {
+    XImage       *img;
+    const XImage *origin;  // the image it stands for
+    bool          owned;   // a private copy, freed with the last reference
+    usize         refs;
+} coom_export_source;
+
+typedef struct coom_export_job coom_export_job;
+
+// exports run one after the other on a worker thread, the render loop only queues them
+typedef struct {
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      wake;
+    bool                started, quit;
+    coom_export_job    *head, *tail;
+    // shared with the worker under `lock`
+    usize               pending;   // queued and running
+    f32                 progress;  // of the running export
+    char                last[64];  // path of the last finished export
+    bool                last_ok;
+    u64                 serial;  // bumped on every change of the above
+    int                 pipe[2];  // the worker writes a byte per change, wakes coom_wait_display
+    // render loop only
+    coom_export_source *source;  // handed to every export until the capture changes
+    Window              parent;
+    coom_overlay        overlay;
+    bool                shown, redraw;
+    u64                 drawn;
+    f64                 hide_at;
+} coom_exporter;
+
+// back buffer of the software renderer, presented with XShmPutImage or XPutImage without MIT-SHM
+typedef struct {
+    XImage *back;
+    GC      gc;
+    Visual *visual;
+    int     depth;
+    int     completion;  // ShmCompletion event type, 0 without MIT-SHM
+    bool    busy;        // the server has not finished reading `back`
+} coom_soft;
+
+// std140 image of the `Frame` block in the shaders, only the words that changed are re-uploaded
+#define COOM_FRAME_BINDING 0
+typedef struct {
+    vec2_t camera_pos;
+    vec2_t window_size;
+    vec2_t screenshot_size;
+    vec2_t cursor_pos;
+    f32    camera_scale;
+    f32    fl_shadow;
+    f32    fl_radius;
+    f32    _pad;
+} coom_frame_uniforms;
+
+// fragment shader variants, picked per frame by coom_draw so the common case pays for neither the
+// flashlight nor the grid nor a filter. The low bits are the overlays, the rest is the sampling:
+// 0 minifies through the sampler, otherwise it is the coom_filter of the magnified texels + 1
+#define COOM_SHADER_FLASHLIGHT                         1
+#define COOM_SHADER_GRID                               2
+#define COOM_SHADER_SAMPLING(variant)                  ((variant) >> 2)
+#define COOM_SHADER_VARIANT(overlays, minify, filter) ((overlays) | ((minify) ? 0 : (filter) + 1) << 2)
+#define COOM_SHADER_VARIANTS                           ((COOM_FILTER_COUNT + 1) << 2)
+
+// programs are linked on first use, filters nobody picks cost nothing at startup
+typedef struct {
+    GLuint vertex;
+    GLuint progs[COOM_SHADER_VARIANTS];  // 0 until used
+    int    bound;                        // variant 0 after coom_initialize_shader
+} coom_shaders;
+
+// GPU time per shader variant from GL_TIME_ELAPSED queries, read a few frames late so nothing stalls
+#define COOM_GPU_QUERIES 4
+typedef struct {
+    bool   supported;
+    bool   active;  // a query is open for the current frame
+    GLuint ids[COOM_GPU_QUERIES];
+    int    variant[COOM_GPU_QUERIES];
+    bool   pending[COOM_GPU_QUERIES];
+    usize  next;
+    u64    time[COOM_SHADER_VARIANTS];  // nanoseconds, summed until the reader resets them
+    u64    frames[COOM_SHADER_VARIANTS];
+} coom_gpu_timer;
+
+// GL calls issued by the per-frame paths, reset by `coom_end`
+extern u32 coom_gl_calls;
+#define COOM_GL(call) (coom_gl_calls += 1, call)
+// Xlib calls that wait for a reply from the server, reset by `coom_end`
+extern u32 coom_x_round_trips;
+#define COOM_X_ROUND_TRIP(call) (coom_x_round_trips += 1, call)
+
 typedef struct {
-    bool            quit;
-    bool            windowed;
-    short           rate;
-    float           dt;
-
-    GLuint          prog, vao, vbo, ebo;
-    Atom            delete_msg;
-    Window          win;
-    vec2_t          winsize;
-    coom_camera     cam;
-    coom_mouse      mouse;
-    coom_flashlight fl;
-    coom_config_t  *cfg;
-    Display        *dpy;
-    XImage         *img;
+    u64 frames;
+    u64 gl_calls;
+    u64 round_trips;
+    f64 since;  // start of the current report window
+    f64 cpu;    // process cpu time at `since`
+} coom_stats;
+
+typedef struct {
+    bool                quit;
+    bool                windowed;
+    bool                dirty;    // something to redraw, `coom_begin` blocks on the connection otherwise
+    bool                resized;  // `winsize` changed, the viewport follows on the next frame
+    short               rate;
+    float               dt;     // measured time since the previous frame
+    f64                 frame_start;
+    bool                paced;  // no swap control, coom_end sleeps to `rate` instead
+
+    coom_renderer       renderer;
+    coom_soft           soft;
+    coom_shaders        shaders;
+    GLuint              vao, vbo, ebo, ubo;
+    coom_filter         filter;       // cfg->filter, stepped down while frames run over the refresh budget
+    int                 late_frames;  // in a row, see coom_filter_budget
+    coom_gpu_timer      timer;
+    coom_frame_uniforms uniforms;  // last uploaded to `ubo`
+    coom_texture        tex;
+    Atom                delete_msg;
+    Window              win;
+    vec2_t              winsize;
+    coom_camera         cam;
+    coom_mouse          mouse;
+    coom_flashlight     fl;
+    coom_config_t      *cfg;
+    Display            *dpy;
+    Window              target;
+    coom_rect           area;  // captured part of `target`
+    coom_rect           geom;  // zoom window geometry on the root
+    XImage             *img;
+    coom_live           live;
+    coom_loupe          loupe;
+    coom_inspector      inspector;
+    coom_clipboard      clipboard;
+    coom_exporter       exporter;
+    coom_stats          stats;
 } coom_t;
 
+// part of a `width` x `height` capture seen through `cam` in a `winsize` window
+coom_rect coom_camera_visible(const coom_camera *cam, vec2_t winsize, int width, int height);
+// capture coordinates under the window point `p`, the same mapping as coom_camera_visible
+vec2_t    coom_camera_image(const coom_camera *cam, vec2_t winsize, int width, int height, vec2_t p);
+
 coom_t coom_init_coom(options_args args);
 void   coom_uninit_coom(coom_t *c);
 void   coom_begin(coom_t *c);
@@ -110,13 +399,228 @@ void   coom_draw(coom_t *c);
 
 Display *coom_open_display(void);
 Window   coom_select_window(Display *d);
+// refresh rate of the screen, COOM_DEFAULT_RATE when XRandR does not know it
 short    coom_get_monitor_rate(Display *d);
-GLuint   coom_initialize_shader(GLuint *vao, GLuint *vbo, GLuint *ebo, XImage *img);
-void     coom_uninitialize_shader(GLuint *vao, GLuint *vbo, GLuint *ebo, GLuint *program);
+// false when neither GLX_EXT_swap_control nor GLX_MESA_swap_control is there
+bool     coom_set_swap_interval(Display *d, GLXDrawable drawable, coom_vsync vsync);
+// binds variant 0, the others are built by coom_use_shader when first asked for
+void     coom_initialize_shader(coom_shaders *shaders, GLuint *vao, GLuint *vbo, GLuint *ebo, GLuint *ubo, const coom_texture *tex);
+void     coom_uninitialize_shader(coom_shaders *shaders, GLuint *vao, GLuint *vbo, GLuint *ebo, GLuint *ubo);
+void     coom_use_shader(coom_shaders *shaders, int variant);
+const char *coom_shader_variant_name(int variant);
+void     coom_gpu_timer_init(coom_gpu_timer *t);
+void     coom_gpu_timer_uninit(coom_gpu_timer *t);
+// time the draws between begin and end as `variant`
+void     coom_gpu_timer_begin(coom_gpu_timer *t, int variant);
+void     coom_gpu_timer_end(coom_gpu_timer *t);
+// add the finished queries to `time`, `wait` blocks until all of them are
+void     coom_gpu_timer_collect(coom_gpu_timer *t, bool wait);
+// upload the range of `next` that differs from `uploaded`, nothing when the frame did not change
+void     coom_update_uniforms(GLuint ubo, coom_frame_uniforms *uploaded, const coom_frame_uniforms *next);
+// lays out the tiles, their storage is allocated by `coom_upload_texture` once the pixel format is known
+void     coom_initialize_texture(coom_texture *tex, int width, int height);
+void     coom_upload_texture(coom_texture *tex, XImage *img);
+void     coom_uninitialize_texture(coom_texture *tex);
+// upload the (x, y, w, h) rectangle of `img` into the same place of `tex`
+void     coom_update_texture(coom_texture *tex, XImage *img, int x, int y, int w, int h);
+// nearest sampling while magnifying, mipmapped sampling once `scale` drops below 1. the mip
+// chains are only built then, one tile per call so the cost is spread across frames. true while
+// some chain is still missing and another call is needed
+bool     coom_update_texture_filter(coom_texture *tex, f32 scale);
+// draw the tiles overlapping `visible` (capture pixels), returns how many were drawn
+usize    coom_draw_texture(const coom_texture *tex, coom_rect visible);
 
 vec2_t   coom_mouse_pos(Display *dpy);
+// block until an event is queued on `dpy`, `fd` is readable or `timeout` ms passed. -1 for no
+// `fd` and no timeout
+void     coom_wait_display(Display *dpy, int fd, int timeout);
+
+// clip `win` to the circle inscribed in its `size` square, false without the SHAPE extension
+bool     coom_shape_circle(Display *d, Window win, int size);
+
+// drag a rectangle on the root with a xor outline, false when cancelled or empty
+bool      coom_select_region(Display *d, coom_rect *out);
+// geometry of `w` in its own coordinates (x = y = 0)
+coom_rect coom_window_rect(Display *d, Window w);
+// `query` is an output name, an index into the active outputs or "cursor" for the one under the pointer
+bool      coom_find_monitor(Display *d, const char *query, coom_rect *out);
 
-XImage  *coom_new_screenshot(Display *dpy, Window win);
-void     coom_delete_screenshot(XImage *img);
+// ZPixmap image in a MIT-SHM segment attached to the server, NULL when MIT-SHM is missing or
+// unusable (e.g. remote display). freed with coom_delete_screenshot
+XImage  *coom_new_shm_image(Display *dpy, Visual *visual, int depth, int width, int height);
+XImage  *coom_new_screenshot(Display *dpy, Window win, coom_rect area);
+// 32-bit BGRX image filled with a test pattern, needs no display
+XImage  *coom_new_synthetic_screenshot(int width, int height);
+void     coom_delete_screenshot(Display *dpy, XImage *img);
+// release the server side of a MIT-SHM capture, the pixels stay valid
+void     coom_detach_screenshot(Display *dpy, XImage *img);
 bool     coom_save_to_ppm(XImage *img, const char *file_path);
+// 0xRRGGBB of a `pixel` of `img`, through its channel masks so any TrueColor visual works
+u32      coom_decode_pixel(const XImage *img, unsigned long pixel);
+
+// capture on a second connection in a worker thread, so it overlaps with GLX initialization
+typedef struct {
+    Window    target;
+    coom_rect area;
+    XImage   *img;
+    pthread_t thread;
+    bool      running;
+} coom_capture;
+bool     coom_capture_start(coom_capture *cap);
+XImage  *coom_capture_join(Display *dpy, coom_capture *cap);
+
+// live capture, returns None when the XDamage extension is missing
+Damage   coom_new_damage(Display *dpy, Drawable target, int *event_base);
+void     coom_delete_damage(Display *dpy, Damage damage);
+// re-grab only the damaged rectangles of `area` into `img` and `tex`, returns the refreshed pixel count.
+// with a `history` the change is recorded and the texture is left alone while scrubbing
+usize    coom_refresh_damage(Display *dpy, Damage damage, Drawable target, coom_rect area, XImage *img, coom_texture *tex, coom_history *history);
+
+///////////////////////////////////////////////////////////////////////
+/// HISTORY
+///////////////////////////////////////////////////////////////////////
+bool     coom_history_init(coom_history *h, XImage *img, usize budget);
+void     coom_history_uninit(coom_history *h);
+// `begin` saves `rect` of `img` before it is re-grabbed, `commit` stores the difference
+void     coom_history_begin(coom_history *h, XImage *img, coom_rect rect);
+void     coom_history_commit(coom_history *h, XImage *img);
+// step the view one frame back (direction < 0) or forward, `changed` is the part to re-upload
+bool     coom_history_step(coom_history *h, XImage *img, int direction, coom_rect *changed);
+
+///////////////////////////////////////////////////////////////////////
+/// PIXEL CONVERSION
+///////////////////////////////////////////////////////////////////////
+// from the slowest to the fastest, each one only applies to the layouts and CPUs it was written for
+typedef enum {
+    COOM_CONVERT_GENERIC,  // any visual, decoded through the channel masks
+    COOM_CONVERT_BGRX,     // 32-bit pixels with blue in the lowest byte
+    COOM_CONVERT_SSSE3,
+    COOM_CONVERT_AVX2,
+    COOM_CONVERT_COUNT,
+} coom_convert;
+// one row of `img` as packed 8-bit RGB, 3 * width bytes
+typedef void (*coom_rgb_row_fn)(const XImage *img, int y, u8 *out);
+// fastest converter up to `limit` that fits the layout of `img` and the CPU we run on
+coom_rgb_row_fn coom_rgb_row_converter(const XImage *img, coom_convert limit, coom_convert *picked);
+const char     *coom_convert_name(coom_convert convert);
+
+///////////////////////////////////////////////////////////////////////
+/// PNG
+///////////////////////////////////////////////////////////////////////
+typedef struct coom_png_slot coom_png_slot;
+// pull encoder, every coom_png_next hands out the next piece of the file. the image data is
+// filtered and deflated a batch of row chunks at a time across the thread pool
+typedef struct {
+    const XImage   *img;
+    coom_rgb_row_fn row;
+    int             level;  // zlib level, 0 stores
+    int             chunk_rows, dict_rows;
+    usize           stride;  // filter byte and RGB of one row
+    usize           chunks, next;
+    u32             adler;  // of the image data handed out so far
+    coom_png_slot  *slots;  // one chunk of the batch each
+    usize           slot_count;
+    u8             *out;
+    usize           out_size, out_cap;
+    int             stage;
+    bool            failed;
+} coom_png;
+bool     coom_png_begin(coom_png *png, const XImage *img, int level);
+// next piece of the file in `data`, valid until the next call. false after the last one or on error
+bool     coom_png_next(coom_png *png, const u8 **data, usize *size);
+void     coom_png_end(coom_png *png);
+// `progress`, when not NULL, gets the fraction of the image written after every batch
+typedef void (*coom_progress_fn)(void *ctx, f32 done);
+bool     coom_save_to_png(const XImage *img, const char *file_path, int level, coom_progress_fn progress, void *ctx);
+
+///////////////////////////////////////////////////////////////////////
+/// EXPORT
+///////////////////////////////////////////////////////////////////////
+// the part of `src` seen through `cam` in a `winsize` window, resampled on the CPU to `scale`
+// output pixels per window pixel. NULL when nothing of the capture is visible, freed with
+// coom_delete_screenshot
+XImage  *coom_export_view(const XImage *src, const coom_camera *cam, vec2_t winsize, f32 scale);
+// start the worker, progress is shown in an overlay of `parent`
+bool     coom_exporter_init(coom_exporter *ex, Window parent);
+// queue an export of `img`. with `live` the image changes under us, it is copied once and the
+// copy is shared by every export queued until coom_exporter_invalidate. otherwise it is only
+// pinned and has to outlive the exporter
+void     coom_exporter_submit(coom_exporter *ex, const XImage *img, bool live, const coom_export_request *req);
+// the image handed to the last coom_exporter_submit changed
+void     coom_exporter_invalidate(coom_exporter *ex);
+// drain the wake pipe and redraw the overlay, returns the ms until it wants another call, -1 never
+int      coom_exporter_update(coom_exporter *ex, Display *dpy);
+// finishes the queued exports first
+void     coom_exporter_uninit(coom_exporter *ex, Display *dpy);
+
+///////////////////////////////////////////////////////////////////////
+/// OVERLAY
+///////////////////////////////////////////////////////////////////////
+// unmapped child of `parent` at `slot`, a COOM_OVERLAY_* value, sized for `widest`
+void     coom_overlay_create(coom_overlay *ov, Display *dpy, Window parent, int slot, const char *widest);
+// NULL lines are drawn empty
+void     coom_overlay_draw(coom_overlay *ov, Display *dpy, const char *lines[COOM_OVERLAY_LINES]);
+void     coom_overlay_destroy(coom_overlay *ov, Display *dpy);
+
+///////////////////////////////////////////////////////////////////////
+/// INSPECTOR
+///////////////////////////////////////////////////////////////////////
+// show or hide the overlay in the top left corner of `parent`
+void     coom_inspector_toggle(coom_inspector *in, Display *dpy, Window parent, int size);
+// read pixel (x, y) of `img` and the square around it, and redraw the overlay
+void     coom_inspector_update(coom_inspector *in, Display *dpy, const XImage *img, int x, int y);
+// "#rrggbb" of the hovered pixel or of the average, in a static buffer
+const char *coom_inspector_hex(const coom_inspector *in, bool average);
+void     coom_inspector_uninit(coom_inspector *in, Display *dpy);
+
+///////////////////////////////////////////////////////////////////////
+/// CLIPBOARD
+///////////////////////////////////////////////////////////////////////
+void     coom_clipboard_init(coom_clipboard *cb, Display *dpy);
+// take the CLIPBOARD selection for `win` with a copy of `text`, `time` of the triggering event
+bool     coom_clipboard_set_text(coom_clipboard *cb, Display *dpy, Window win, const char *text, Time time);
+// same with `img`, which the clipboard takes over, as image/png at zlib `level` and
+// image/x-portable-pixmap. both are encoded on demand, a chunk per INCR step
+bool     coom_clipboard_set_image(coom_clipboard *cb, Display *dpy, Window win, XImage *img, int level, Time time);
+// answer SelectionRequest and SelectionClear and move INCR transfers along, false for any other event
+bool     coom_clipboard_handle(coom_clipboard *cb, Display *dpy, XEvent *ev);
+// after the display of the zoom window is closed: fork a process with a connection of its own
+// that keeps serving what we own until another client takes the selection
+void     coom_clipboard_persist(coom_clipboard *cb);
+void     coom_clipboard_uninit(coom_clipboard *cb);
+
+///////////////////////////////////////////////////////////////////////
+/// SOFTWARE RENDERER
+///////////////////////////////////////////////////////////////////////
+// draw `src` as seen through `cam` into `dst`, both 32 bits per pixel in the same format. nearest
+// while magnifying and bilinear below 1x like the GL path, rows are split across the thread pool
+void     coom_soft_draw(XImage *dst, const XImage *src, const coom_camera *cam, vec2_t cursor, const coom_flashlight *fl);
+void     coom_soft_init(coom_soft *soft, Display *dpy, Window win);
+// (re)create the back buffer, false when the visual is not 32 bits per pixel
+bool     coom_soft_resize(coom_soft *soft, Display *dpy, int width, int height);
+// wait until the server finished reading the back buffer of the previous present
+void     coom_soft_wait(coom_soft *soft, Display *dpy);
+void     coom_soft_present(coom_soft *soft, Display *dpy, Window win);
+void     coom_soft_uninit(coom_soft *soft, Display *dpy);
+
+///////////////////////////////////////////////////////////////////////
+/// EGL
+///////////////////////////////////////////////////////////////////////
+// desktop GL context without any X server, surfaceless when the driver allows it and on a
+// 1x1 pbuffer otherwise. everything is drawn into `fbo`, which stays bound
+typedef struct {
+    EGLDisplay dpy;
+    EGLContext ctx;
+    EGLSurface surface;
+    GLuint     fbo, color;
+    int        width, height;
+} coom_egl;
+bool     coom_egl_begin(coom_egl *egl, int width, int height);
+void     coom_egl_end(coom_egl *egl);
+
+///////////////////////////////////////////////////////////////////////
+/// BENCHMARKS
+///////////////////////////////////////////////////////////////////////
+// run the benchmark called `name` ("list" prints them), false when it does not exist or failed
+bool     coom_run_bench(const char *name);
 #endif  // __COOMER_H__
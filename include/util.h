@@ -147,4 +147,20 @@ typedef struct {
 vec2_t vec2_normalize(vec2_t v);
 
 void   mssleep(u32 ms);
+// monotonic clock in seconds, only meaningful as a difference between two calls
+f64    coom_time_now(void);
+// sleep until coom_time_now() reaches `deadline`, returns at once when it is already past
+void   coom_sleep_until(f64 deadline);
+// user + system time of the whole process in seconds
+f64    coom_cpu_time(void);
+// whole word match of `name` in a space separated extension string, names are prefixes of each other
+bool   coom_has_extension(const char *list, const char *name);
+
+// run `fn` over [0, count) split in bands, on a pool of one thread per core that is started on
+// the first call. the caller works on bands too and returns once all of them are done. safe to
+// call from several threads at once, the workers share themselves between the running jobs
+typedef void (*coom_parallel_fn)(void *ctx, usize begin, usize end);
+void   coom_parallel_for(usize count, coom_parallel_fn fn, void *ctx);
+usize  coom_parallel_threads(void);
+void   coom_parallel_uninit(void);
 #endif
@@ -0,0 +1,336 @@
+#include <unistd.h>
+#include <zlib.h>
+
+#include "coomer.h"
+
+#define BENCH_WIDTH  3840
+#define BENCH_HEIGHT 2160
+// zoom window of the headless bench
+#define BENCH_WINDOW_WIDTH  1920
+#define BENCH_WINDOW_HEIGHT 1080
+
+typedef struct {
+    Display   *dpy;
+    Window     win;
+    GLXContext ctx;
+} coom_bench_gl;
+
+// GL context on an unmapped window, enough for uploads and offscreen work
+static bool coom_bench_gl_begin(coom_bench_gl *gl) {
+    gl->dpy = XOpenDisplay(NULL);
+    if (gl->dpy == NULL) {
+        coom_error("bench: failed to open display");
+        return false;
+    }
+    int          attr[] = {GLX_RGBA, GLX_DEPTH_SIZE, 24, GLX_DOUBLEBUFFER, None};
+    XVisualInfo *vi     = glXChooseVisual(gl->dpy, 0, &attr[0]);
+    if (vi == NULL) {
+        coom_error("bench: failed to choose appropriate visual - glXChooseVisual");
+        XCloseDisplay(gl->dpy);
+        return false;
+    }
+    XSetWindowAttributes swa = {.colormap = XCreateColormap(gl->dpy, DefaultRootWindow(gl->dpy), vi->visual, AllocNone)};
+    gl->win = XCreateWindow(gl->dpy, DefaultRootWindow(gl->dpy), 0, 0, 16, 16, 0, vi->depth, InputOutput, vi->visual, CWColormap, &swa);
+    gl->ctx = glXCreateContext(gl->dpy, vi, NULL, GL_TRUE);
+    XFree(vi);
+    glXMakeCurrent(gl->dpy, gl->win, gl->ctx);
+    coom_log(stdout, "GL renderer: %s", glGetString(GL_RENDERER));
+    return true;
+}
+
+static void coom_bench_gl_end(coom_bench_gl *gl) {
+    glXMakeCurrent(gl->dpy, None, NULL);
+    glXDestroyContext(gl->dpy, gl->ctx);
+    XDestroyWindow(gl->dpy, gl->win);
+    XCloseDisplay(gl->dpy);
+}
+
+static void coom_bench_upload_report(const char *setup, XImage *img, f64 initial, f64 blocking, f64 total, int iterations) {
+    f64 mb = (f64)img->bytes_per_line * img->height / (1024.0 * 1024.0);
+    coom_log(stdout, "upload %dx%d %-30s: first %7.2f ms, blocking %7.2f ms, finished %7.2f ms, %8.1f MB/s", img->width, img->height, setup, initial * 1000.0,
+             blocking * 1000.0 / iterations, total * 1000.0 / iterations, mb * iterations / total);
+}
+
+static bool coom_bench_upload(void) {
+    coom_bench_gl gl = {0};
+    if (!coom_bench_gl_begin(&gl)) return false;
+
+    const int iterations = 20;
+    XImage   *img        = coom_new_synthetic_screenshot(BENCH_WIDTH, BENCH_HEIGHT);
+
+    // the setup before immutable storage: 24-bit internal format fed with 32-bit BGRA
+    GLuint    legacy     = 0;
+    glGenTextures(1, &legacy);
+    glBindTexture(GL_TEXTURE_2D, legacy);
+    f64 start = coom_time_now();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img->width, img->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, img->data);
+    f64 initial = coom_time_now() - start;
+    glFinish();
+    f64 blocking = 0.0, total = 0.0;
+    for (int i = 0; i < iterations; ++i) {
+        start = coom_time_now();
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img->width, img->height, GL_BGRA, GL_UNSIGNED_BYTE, img->data);
+        blocking += coom_time_now() - start;
+        glFinish();
+        total += coom_time_now() - start;
+    }
+    coom_bench_upload_report("GL_RGB, client memory", img, initial, blocking, total, iterations);
+    glDeleteTextures(1, &legacy);
+
+    for (int client = 1; client >= 0; --client) {
+        coom_texture tex = {.client_upload = client};
+        coom_initialize_texture(&tex, img->width, img->height);
+        start = coom_time_now();
+        coom_upload_texture(&tex, img);
+        initial = coom_time_now() - start;
+        glFinish();
+
+        blocking = total = 0.0;
+        for (int i = 0; i < iterations; ++i) {
+            start = coom_time_now();
+            coom_update_texture(&tex, img, 0, 0, img->width, img->height);
+            blocking += coom_time_now() - start;
+            glFinish();
+            total += coom_time_now() - start;
+        }
+        coom_bench_upload_report(client ? "immutable RGBA8, client memory" : "immutable RGBA8, pbo", img, initial, blocking, total, iterations);
+        coom_uninitialize_texture(&tex);
+    }
+    coom_delete_screenshot(NULL, img);
+    coom_bench_gl_end(&gl);
+    return true;
+}
+
+typedef struct {
+    const char *name;
+    f32         scale;
+    bool        flashlight;
+    coom_filter filter;
+} coom_bench_view;
+
+// shared by the renderer benches so their numbers compare line by line
+static const coom_bench_view bench_views[] = {
+    {"1x", 1.0, false, COOM_FILTER_NEAREST},
+    {"4x", 4.0, false, COOM_FILTER_NEAREST},
+    {"0.5x minified", 0.5, false, COOM_FILTER_NEAREST},
+    {"2x flashlight", 2.0, true, COOM_FILTER_NEAREST},
+    {"0.5x flashlight", 0.5, true, COOM_FILTER_NEAREST},
+    {"3x bicubic", 3.0, false, COOM_FILTER_BICUBIC},
+    {"3x lanczos2", 3.0, false, COOM_FILTER_LANCZOS2},
+    {"3x lanczos3", 3.0, false, COOM_FILTER_LANCZOS3},
+    {"16x grid", 16.0, false, COOM_FILTER_NEAREST},
+};
+#define BENCH_VIEW_COUNT (sizeof(bench_views) / sizeof(bench_views[0]))
+
+static void coom_bench_draw_report(const char *renderer, XImage *img, int width, int height, const char *view, f64 frame, f64 calls) {
+    coom_log(stdout, "%-4s %dx%d into %dx%d %-15s: %7.3f ms/frame, %7.1f fps, %8.1f Mpix/s fill, %5.1f GL calls/frame", renderer, img->width, img->height, width,
+             height, view, frame * 1000.0, 1.0 / frame, (f64)width * height / frame / 1e6, calls);
+}
+
+// the whole coom_draw path on a synthetic capture, drawn into an EGL framebuffer object
+static bool coom_bench_headless(void) {
+    coom_egl egl = {0};
+    if (!coom_egl_begin(&egl, BENCH_WINDOW_WIDTH, BENCH_WINDOW_HEIGHT)) return false;
+    coom_log(stdout, "GL renderer: %s", glGetString(GL_RENDERER));
+
+    coom_config_t cfg = default_config;
+    coom_t        c   = {.rate = COOM_DEFAULT_RATE, .dt = 1.0 / COOM_DEFAULT_RATE, .cfg = &cfg, .winsize = vec2(egl.width, egl.height)};
+    c.img             = coom_new_synthetic_screenshot(BENCH_WIDTH, BENCH_HEIGHT);
+    coom_initialize_texture(&c.tex, c.img->width, c.img->height);
+    coom_initialize_shader(&c.shaders, &c.vao, &c.vbo, &c.ebo, &c.ubo, &c.tex);
+    coom_gpu_timer_init(&c.timer);
+    coom_upload_texture(&c.tex, c.img);
+    glFinish();
+
+    const int warmup = 16, frames = 120;
+    for (usize v = 0; v < BENCH_VIEW_COUNT; ++v) {
+        c.cam    = (coom_camera){.scale = bench_views[v].scale};
+        c.filter = bench_views[v].filter;
+        c.fl  = (coom_flashlight){.enabled = bench_views[v].flashlight, .radius = 200.0, .shadow = bench_views[v].flashlight ? 0.8 : 0.0};
+        // long enough for the mip chains, which are built one tile per frame
+        for (int i = 0; i < warmup; ++i) coom_draw(&c);
+        glFinish();
+        coom_gpu_timer_collect(&c.timer, true);
+        memset(c.timer.time, 0, sizeof(c.timer.time));
+        memset(c.timer.frames, 0, sizeof(c.timer.frames));
+
+        coom_gl_calls = 0;
+        f64 start     = coom_time_now();
+        for (int i = 0; i < frames; ++i) {
+            // pan so every frame changes the uniforms like a real drag would
+            c.cam.position = vec2(i % 64, i % 32);
+            c.mouse.curr   = vec2(egl.width / 2 + i, egl.height / 2);
+            coom_draw(&c);
+            glFinish();
+        }
+        coom_bench_draw_report("gl", c.img, egl.width, egl.height, bench_views[v].name, (coom_time_now() - start) / frames, (f64)coom_gl_calls / frames);
+        coom_gpu_timer_collect(&c.timer, true);
+        for (int i = 0; i < COOM_SHADER_VARIANTS; ++i) {
+            if (c.timer.frames[i] > 0)
+                coom_log(stdout, "     %-24s shader: %7.3f ms gpu/frame", coom_shader_variant_name(i), c.timer.time[i] / 1e6 / c.timer.frames[i]);
+        }
+    }
+
+    coom_uninitialize_texture(&c.tex);
+    coom_gpu_timer_uninit(&c.timer);
+    coom_uninitialize_shader(&c.shaders, &c.vao, &c.vbo, &c.ebo, &c.ubo);
+    coom_delete_screenshot(NULL, c.img);
+    coom_egl_end(&egl);
+    return true;
+}
+
+// the same views as the headless bench through coom_soft_draw, without the presentation
+static bool coom_bench_soft(void) {
+    XImage *src = coom_new_synthetic_screenshot(BENCH_WIDTH, BENCH_HEIGHT);
+    XImage *dst = coom_new_synthetic_screenshot(BENCH_WINDOW_WIDTH, BENCH_WINDOW_HEIGHT);
+    coom_log(stdout, "soft renderer: %zu threads", coom_parallel_threads());
+
+    const int warmup = 4, frames = 120;
+    for (usize v = 0; v < BENCH_VIEW_COUNT; ++v) {
+        // no reconstruction filters or grid on the CPU, the bilinear minification is all there is
+        if (bench_views[v].filter != COOM_FILTER_NEAREST || bench_views[v].scale >= default_config.grid_scale) continue;
+        coom_camera     cam = {.scale = bench_views[v].scale};
+        coom_flashlight fl  = {.enabled = bench_views[v].flashlight, .radius = 200.0, .shadow = bench_views[v].flashlight ? 0.8 : 0.0};
+        vec2_t          cursor = vec2(dst->width / 2, dst->height / 2);
+        for (int i = 0; i < warmup; ++i) coom_soft_draw(dst, src, &cam, cursor, &fl);
+
+        f64 start = coom_time_now();
+        for (int i = 0; i < frames; ++i) {
+            cam.position = vec2(i % 64, i % 32);
+            cursor       = vec2(dst->width / 2 + i, dst->height / 2);
+            coom_soft_draw(dst, src, &cam, cursor, &fl);
+        }
+        coom_bench_draw_report("soft", src, dst->width, dst->height, bench_views[v].name, (coom_time_now() - start) / frames, 0.0);
+    }
+    coom_delete_screenshot(NULL, dst);
+    coom_delete_screenshot(NULL, src);
+    coom_parallel_uninit();
+    return true;
+}
+
+// every converter on the same capture, checked against the generic one, then a whole save
+static bool coom_bench_ppm(void) {
+    XImage   *img        = coom_new_synthetic_screenshot(BENCH_WIDTH, BENCH_HEIGHT);
+    usize     stride     = (usize)img->width * 3;
+    u8       *expected   = coom_alloc(NULL, stride * img->height);
+    u8       *out        = coom_alloc(NULL, stride * img->height);
+    f64       mb         = (f64)stride * img->height / (1024.0 * 1024.0);
+    const int iterations = 10;
+
+    // the per-pixel loop coom_save_to_ppm used to run, for reference
+    f64 start = coom_time_now();
+    for (int y = 0; y < img->height; ++y) {
+        for (int x = 0; x < img->width; ++x) {
+            unsigned long pixel = XGetPixel(img, x, y);
+            u8           *rgb   = &out[y * stride + x * 3];
+            rgb[0] = pixel >> 16, rgb[1] = pixel >> 8, rgb[2] = pixel;
+        }
+    }
+    f64 elapsed = coom_time_now() - start;
+    coom_log(stdout, "ppm %dx%d %-12s: %7.2f ms/image, %8.1f MB/s of RGB", img->width, img->height, "XGetPixel", elapsed * 1000.0, mb / elapsed);
+
+    bool         result = true;
+    coom_convert last   = COOM_CONVERT_COUNT;
+    for (int limit = COOM_CONVERT_GENERIC; limit < COOM_CONVERT_COUNT && result; ++limit) {
+        coom_convert    picked;
+        coom_rgb_row_fn row = coom_rgb_row_converter(img, limit, &picked);
+        // not supported by this CPU, the lower one was already measured
+        if (picked == last) continue;
+        last  = picked;
+        start = coom_time_now();
+        for (int i = 0; i < iterations; ++i) {
+            for (int y = 0; y < img->height; ++y) row(img, y, out + y * stride);
+        }
+        elapsed = (coom_time_now() - start) / iterations;
+        if (picked == COOM_CONVERT_GENERIC) memcpy(expected, out, stride * img->height);
+        bool same = memcmp(expected, out, stride * img->height) == 0;
+        coom_log(stdout, "ppm %dx%d %-12s: %7.2f ms/image, %8.1f MB/s of RGB%s", img->width, img->height, coom_convert_name(picked), elapsed * 1000.0,
+                 mb / elapsed, same ? "" : ", MISMATCH against generic");
+        result = same;
+    }
+
+    char path[] = "/tmp/coomer-bench-XXXXXX";
+    int  fd     = result ? mkstemp(path) : -1;
+    if (fd >= 0) {
+        close(fd);
+        start   = coom_time_now();
+        result  = coom_save_to_ppm(img, path);
+        elapsed = coom_time_now() - start;
+        unlink(path);
+        if (result) coom_log(stdout, "ppm %dx%d %-12s: %7.2f ms/image, %8.1f MB/s of RGB", img->width, img->height, "save to file", elapsed * 1000.0, mb / elapsed);
+    } else if (result) {
+        coom_error("bench: failed to create a temporary file - %s", strerror(errno));
+        result = false;
+    }
+
+    coom_free(expected);
+    coom_free(out);
+    coom_delete_screenshot(NULL, img);
+    return result;
+}
+
+// the encoder at a few levels on a 4K capture, every file inflated back and checked
+static bool coom_bench_png(void) {
+    XImage   *img    = coom_new_synthetic_screenshot(BENCH_WIDTH, BENCH_HEIGHT);
+    usize     raw    = ((usize)img->width * 3 + 1) * img->height;
+    u8       *check  = coom_alloc(NULL, raw);
+    bool      result = true;
+    const int levels[] = {0, 1, 3, 6, 9};
+    coom_log(stdout, "png: %zu threads", coom_parallel_threads());
+    for (usize l = 0; l < sizeof(levels) / sizeof(levels[0]) && result; ++l) {
+        coom_png png;
+        if (!coom_png_begin(&png, img, levels[l])) return false;
+        // the encoded file is gathered in memory, the bench measures the encoder and not the disk
+        strbuilder file = {0};
+        const u8  *data;
+        usize      size;
+        f64        start = coom_time_now();
+        while (coom_png_next(&png, &data, &size)) sb_append_buf(&file, data, size);
+        f64 elapsed = coom_time_now() - start;
+        result      = !png.failed;
+        coom_png_end(&png);
+
+        // IDAT payloads put back together are one zlib stream, uncompress checks the adler32
+        strbuilder stream = {0};
+        const u8  *bytes  = (const u8 *)file.items;
+        for (usize at = 8; result && at + 12 <= file.count;) {
+            u32 length = (u32)bytes[at] << 24 | bytes[at + 1] << 16 | bytes[at + 2] << 8 | bytes[at + 3];
+            if (memcmp(&bytes[at + 4], "IDAT", 4) == 0) sb_append_buf(&stream, &bytes[at + 8], length);
+            at += 12 + length;
+        }
+        uLongf inflated = raw;
+        result          = result && uncompress(check, &inflated, (const u8 *)stream.items, stream.count) == Z_OK && inflated == raw;
+        coom_log(stdout, "png %dx%d level %d: %7.2f ms/image, %8.1f MB/s of RGB, %6.2f MB, %5.1f%% of raw%s", img->width, img->height, levels[l],
+                 elapsed * 1000.0, (f64)img->width * img->height * 3 / elapsed / (1024.0 * 1024.0), file.count / (1024.0 * 1024.0), 100.0 * file.count / raw,
+                 result ? "" : ", BROKEN STREAM");
+        sb_free(file);
+        sb_free(stream);
+    }
+    coom_free(check);
+    coom_delete_screenshot(NULL, img);
+    return result;
+}
+
+typedef struct {
+    const char *name;
+    const char *description;
+    bool (*run)(void);
+} coom_bench;
+
+static const coom_bench benches[] = {
+    {"upload", "4K texture upload: legacy GL_RGB, immutable storage from client memory and through PBOs", coom_bench_upload},
+    {"headless", "frame time and fill rate of coom_draw on a 4K synthetic capture, EGL without an X server", coom_bench_headless},
+    {"soft", "the headless views through the software renderer, compare with `--bench headless`", coom_bench_soft},
+    {"ppm", "RGB row conversion of a 4K capture per converter and a full coom_save_to_ppm", coom_bench_ppm},
+    {"png", "parallel PNG encoding of a 4K capture at a few zlib levels, with a round trip check", coom_bench_png},
+};
+
+bool coom_run_bench(const char *name) {
+    bool list = strcmp(name, "list") == 0;
+    for (usize i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        if (list) coom_log(stdout, "%-10s %s", benches[i].name, benches[i].description);
+        else if (strcmp(name, benches[i].name) == 0) return benches[i].run();
+    }
+    if (!list) coom_error("Unknown benchmark: '%s', see --bench list", name);
+    return list;
+}
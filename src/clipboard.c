@@ -0,0 +1,300 @@
+#include "coomer.h"
+
+#include <unistd.h>
+#include <X11/Xatom.h>
+
+// upper bound of a property write, the server limit can be lower
+#define COOM_CLIPBOARD_CHUNK (256 * 1024)
+// room for the ChangeProperty request itself inside the server limit
+#define COOM_CLIPBOARD_SLACK 1024
+
+struct coom_clipboard_image {
+    XImage *img;
+    usize   refs;  // the selection and every transfer reading it
+};
+
+// one requestor reading one target, the data is encoded as the requestor asks for more
+struct coom_clipboard_transfer {
+    coom_clipboard_transfer *next;
+    Window                   requestor;
+    Atom                     property, target;
+    coom_clipboard_image    *image;
+    bool                     is_png;
+    coom_png                 png;
+    coom_rgb_row_fn          convert;
+    int                      row;  // next PPM row, -1 before the header
+    const u8                *data;  // encoded and not sent yet
+    usize                    size, offset;
+    u8                      *rows;   // PPM rows converted at once
+    u8                      *chunk;  // what the next property write sends
+};
+
+static void coom_clipboard_release(coom_clipboard_image *image) {
+    if (image == NULL || --image->refs > 0) return;
+    coom_delete_screenshot(NULL, image->img);
+    coom_free(image);
+}
+
+static usize coom_clipboard_max_chunk(Display *dpy) {
+    // both in 4 byte units, the extended one is 0 without BIG-REQUESTS
+    usize max = XExtendedMaxRequestSize(dpy) ? XExtendedMaxRequestSize(dpy) : XMaxRequestSize(dpy);
+    max       = max * 4 - COOM_CLIPBOARD_SLACK;
+    return max < COOM_CLIPBOARD_CHUNK ? max : COOM_CLIPBOARD_CHUNK;
+}
+
+void coom_clipboard_init(coom_clipboard *cb, Display *dpy) {
+    *cb = (coom_clipboard){
+        .clipboard = XInternAtom(dpy, "CLIPBOARD", False),
+        .targets   = XInternAtom(dpy, "TARGETS", False),
+        .utf8      = XInternAtom(dpy, "UTF8_STRING", False),
+        .png       = XInternAtom(dpy, "image/png", False),
+        .ppm       = XInternAtom(dpy, "image/x-portable-pixmap", False),
+        .incr      = XInternAtom(dpy, "INCR", False),
+        .chunk     = coom_clipboard_max_chunk(dpy),
+    };
+}
+
+// drop what we held before, transfers already running keep their image
+static bool coom_clipboard_own(coom_clipboard *cb, Display *dpy, Window win, Time time) {
+    XSetSelectionOwner(dpy, cb->clipboard, win, time);
+    if (COOM_X_ROUND_TRIP(XGetSelectionOwner(dpy, cb->clipboard)) != win) {
+        coom_error("failed to take the CLIPBOARD selection");
+        return false;
+    }
+    coom_free(cb->text);
+    coom_clipboard_release(cb->image);
+    cb->text  = NULL;
+    cb->image = NULL;
+    return true;
+}
+
+bool coom_clipboard_set_text(coom_clipboard *cb, Display *dpy, Window win, const char *text, Time time) {
+    if (!coom_clipboard_own(cb, dpy, win, time)) return false;
+    usize size = strlen(text) + 1;
+    cb->text   = coom_alloc(NULL, size);
+    memcpy(cb->text, text, size);
+    return true;
+}
+
+bool coom_clipboard_set_image(coom_clipboard *cb, Display *dpy, Window win, XImage *img, int level, Time time) {
+    if (!coom_clipboard_own(cb, dpy, win, time)) {
+        coom_delete_screenshot(NULL, img);
+        return false;
+    }
+    cb->image  = coom_alloc(NULL, sizeof(coom_clipboard_image));
+    *cb->image = (coom_clipboard_image){.img = img, .refs = 1};
+    cb->level  = level;
+    return true;
+}
+
+static void coom_clipboard_free_transfer(coom_clipboard_transfer *t) {
+    if (t->is_png) coom_png_end(&t->png);
+    coom_clipboard_release(t->image);
+    coom_free(t->rows);
+    coom_free(t->chunk);
+    coom_free(t);
+}
+
+// next piece of the encoded image in t->data, false once everything was handed out
+static bool coom_clipboard_refill(coom_clipboard_transfer *t) {
+    t->offset = t->size = 0;
+    if (t->is_png) return coom_png_next(&t->png, &t->data, &t->size);
+
+    const XImage *img   = t->image->img;
+    usize         width = (usize)img->width * 3;
+    if (t->row < 0) {
+        t->size = snprintf((char *)t->rows, width + 32, "P6\n%d %d\n255\n", img->width, img->height);
+        t->row  = 0;
+    } else {
+        // as many rows as fit in a property, at least one
+        int rows = COOM_CLIPBOARD_CHUNK / width > 0 ? COOM_CLIPBOARD_CHUNK / width : 1;
+        rows     = t->row + rows < img->height ? rows : img->height - t->row;
+        for (int i = 0; i < rows; ++i) t->convert(img, t->row + i, t->rows + i * width);
+        t->row += rows;
+        t->size = rows * width;
+    }
+    t->data = t->rows;
+    return t->size > 0;
+}
+
+// up to `cap` bytes of the payload in t->chunk, 0 at the end
+static usize coom_clipboard_produce(coom_clipboard_transfer *t, usize cap) {
+    usize filled = 0;
+    while (filled < cap) {
+        if (t->offset == t->size && !coom_clipboard_refill(t)) break;
+        usize n = t->size - t->offset < cap - filled ? t->size - t->offset : cap - filled;
+        memcpy(t->chunk + filled, t->data + t->offset, n);
+        t->offset += n;
+        filled += n;
+    }
+    return filled;
+}
+
+static coom_clipboard_transfer *coom_clipboard_start(coom_clipboard *cb, XSelectionRequestEvent *req, Atom property, usize *estimate) {
+    const XImage            *img = cb->image->img;
+    coom_clipboard_transfer *t   = coom_alloc(NULL, sizeof(coom_clipboard_transfer));
+    *t = (coom_clipboard_transfer){.requestor = req->requestor, .property = property, .target = req->target, .image = cb->image, .row = -1};
+    cb->image->refs += 1;
+    t->chunk = coom_alloc(NULL, cb->chunk);
+    if (req->target == cb->png) {
+        if (!coom_png_begin(&t->png, img, cb->level)) {
+            coom_clipboard_free_transfer(t);
+            return NULL;
+        }
+        t->is_png = true;
+        // a bound on the stored size, the compressed one is not known before the end
+        *estimate = (usize)img->height * (img->width * 3 + 1) + COOM_CLIPBOARD_SLACK;
+    } else {
+        usize width = (usize)img->width * 3;
+        int   rows  = COOM_CLIPBOARD_CHUNK / width > 0 ? COOM_CLIPBOARD_CHUNK / width : 1;
+        t->convert  = coom_rgb_row_converter(img, COOM_CONVERT_COUNT - 1, NULL);
+        t->rows     = coom_alloc(NULL, rows * width + 32);
+        *estimate   = (usize)img->height * width + snprintf(NULL, 0, "P6\n%d %d\n255\n", img->width, img->height);
+    }
+    return t;
+}
+
+// small payloads go out in one property, the rest is announced with INCR and sent as the
+// requestor deletes the property
+static bool coom_clipboard_send_image(coom_clipboard *cb, Display *dpy, XSelectionRequestEvent *req, Atom property) {
+    usize                    estimate = 0;
+    coom_clipboard_transfer *t        = coom_clipboard_start(cb, req, property, &estimate);
+    if (t == NULL) return false;
+    if (estimate <= cb->chunk) {
+        usize size = coom_clipboard_produce(t, cb->chunk);
+        XChangeProperty(dpy, req->requestor, property, req->target, 8, PropModeReplace, t->chunk, size);
+        coom_clipboard_free_transfer(t);
+        return true;
+    }
+    // the INCR size is only a lower bound, a PNG is not known before its last chunk
+    long lower = t->is_png ? 0 : (long)estimate;
+    XSelectInput(dpy, req->requestor, PropertyChangeMask | StructureNotifyMask);
+    XChangeProperty(dpy, req->requestor, property, cb->incr, 32, PropModeReplace, (unsigned char *)&lower, 1);
+    t->next       = cb->transfers;
+    cb->transfers = t;
+    coom_info("clipboard: %s to 0x%lx through INCR", t->is_png ? "image/png" : "image/x-portable-pixmap", req->requestor);
+    return true;
+}
+
+static void coom_clipboard_reply(coom_clipboard *cb, Display *dpy, XSelectionRequestEvent *req) {
+    XSelectionEvent reply = {
+        .type      = SelectionNotify,
+        .display   = dpy,
+        .requestor = req->requestor,
+        .selection = req->selection,
+        .target    = req->target,
+        .property  = None,
+        .time      = req->time,
+    };
+    // clients from before ICCCM 2.0 leave the property out and expect the target name instead
+    Atom property = req->property != None ? req->property : req->target;
+    bool text     = cb->text != NULL && req->selection == cb->clipboard;
+    bool image    = cb->image != NULL && req->selection == cb->clipboard;
+    // anything else is refused with a None property
+    if ((text || image) && req->target == cb->targets) {
+        Atom targets[3] = {cb->targets, text ? cb->utf8 : cb->png, text ? XA_STRING : cb->ppm};
+        XChangeProperty(dpy, req->requestor, property, XA_ATOM, 32, PropModeReplace, (unsigned char *)targets, sizeof(targets) / sizeof(targets[0]));
+        reply.property = property;
+    } else if (text && (req->target == cb->utf8 || req->target == XA_STRING)) {
+        // the text is plain ASCII, it is valid as both
+        XChangeProperty(dpy, req->requestor, property, req->target, 8, PropModeReplace, (unsigned char *)cb->text, strlen(cb->text));
+        reply.property = property;
+    } else if (image && (req->target == cb->png || req->target == cb->ppm)) {
+        if (coom_clipboard_send_image(cb, dpy, req, property)) reply.property = property;
+    }
+    XSendEvent(dpy, req->requestor, False, NoEventMask, (XEvent *)&reply);
+}
+
+// a requestor can read several targets at once, each through its own property. None matches any
+static coom_clipboard_transfer **coom_clipboard_find(coom_clipboard *cb, Window requestor, Atom property) {
+    coom_clipboard_transfer **t = &cb->transfers;
+    while (*t && ((*t)->requestor != requestor || (property != None && (*t)->property != property))) t = &(*t)->next;
+    return t;
+}
+
+static void coom_clipboard_remove(coom_clipboard_transfer **link) {
+    coom_clipboard_transfer *t = *link;
+    *link                      = t->next;
+    coom_clipboard_free_transfer(t);
+}
+
+// the requestor deleted the property, it wants the next chunk. the empty one ends the transfer
+static void coom_clipboard_step(coom_clipboard *cb, Display *dpy, coom_clipboard_transfer **link) {
+    coom_clipboard_transfer *t    = *link;
+    usize                    size = coom_clipboard_produce(t, cb->chunk);
+    if (size == 0 && t->is_png && t->png.failed) coom_error("clipboard: image/png transfer to 0x%lx cut short", t->requestor);
+    XChangeProperty(dpy, t->requestor, t->property, t->target, 8, PropModeReplace, t->chunk, size);
+    if (size > 0) return;
+    XSelectInput(dpy, t->requestor, NoEventMask);
+    coom_clipboard_remove(link);
+}
+
+bool coom_clipboard_handle(coom_clipboard *cb, Display *dpy, XEvent *ev) {
+    switch (ev->type) {
+        case SelectionRequest: coom_clipboard_reply(cb, dpy, &ev->xselectionrequest); return true;
+        case SelectionClear:
+            // running transfers still finish, they hold their own reference
+            if (ev->xselectionclear.selection != cb->clipboard) return true;
+            coom_free(cb->text);
+            coom_clipboard_release(cb->image);
+            cb->text  = NULL;
+            cb->image = NULL;
+            return true;
+        case PropertyNotify: {
+            if (*coom_clipboard_find(cb, ev->xproperty.window, None) == NULL) return false;
+            coom_clipboard_transfer **link = coom_clipboard_find(cb, ev->xproperty.window, ev->xproperty.atom);
+            if (*link && ev->xproperty.state == PropertyDelete) coom_clipboard_step(cb, dpy, link);
+            return true;
+        }
+        case DestroyNotify: {
+            // the requestor went away in the middle of its transfers
+            coom_clipboard_transfer **link = coom_clipboard_find(cb, ev->xdestroywindow.window, None);
+            if (*link == NULL) return false;
+            while (*link) {
+                coom_clipboard_remove(link);
+                link = coom_clipboard_find(cb, ev->xdestroywindow.window, None);
+            }
+            return true;
+        }
+        default: return false;
+    }
+}
+
+void coom_clipboard_persist(coom_clipboard *cb) {
+    if (cb->text == NULL && cb->image == NULL) return;
+    // no thread of ours may hold a lock across the fork, the pool starts again in the child if needed
+    coom_parallel_uninit();
+    pid_t pid = fork();
+    if (pid < 0) {
+        coom_error("clipboard: failed to fork the owner process - %s", strerror(errno));
+        return;
+    }
+    if (pid > 0) {
+        coom_info("clipboard: process %d keeps serving the selection", (int)pid);
+        return;
+    }
+
+    // the transfers belonged to the closed connection, their requestors ask again
+    while (cb->transfers) coom_clipboard_remove(&cb->transfers);
+    Display *dpy = coom_open_display();
+    Window   win = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1, 1, 0, 0, 0);
+    cb->chunk  = coom_clipboard_max_chunk(dpy);
+    XSetSelectionOwner(dpy, cb->clipboard, win, CurrentTime);
+    if (XGetSelectionOwner(dpy, cb->clipboard) == win) {
+        // until someone else owns the selection and the last transfer is done
+        XEvent ev;
+        while (cb->text || cb->image || cb->transfers) {
+            XNextEvent(dpy, &ev);
+            coom_clipboard_handle(cb, dpy, &ev);
+        }
+    }
+    XCloseDisplay(dpy);
+    _exit(0);
+}
+
+void coom_clipboard_uninit(coom_clipboard *cb) {
+    while (cb->transfers) coom_clipboard_remove(&cb->transfers);
+    coom_free(cb->text);
+    coom_clipboard_release(cb->image);
+    *cb = (coom_clipboard){0};
+}
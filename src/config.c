@@ -11,8 +11,26 @@ const coom_config_t default_config = {
     .scroll_speed   = 1.5,
     .drag_friction  = 6.0,
     .scale_friction = 4.0,
+    .history_budget = 64.0,
+    .filter         = COOM_FILTER_NEAREST,
+    .grid_scale     = 8.0,
+    .inspect_size   = 5.0,
+    .png_level      = 3.0,
+    .export_scale   = 1.0,
 };
 
+static const char *coom_filter_names[COOM_FILTER_COUNT] = {"nearest", "bicubic", "lanczos2", "lanczos3"};
+
+const char *coom_filter_name(coom_filter filter) { return coom_filter_names[filter]; }
+
+static coom_filter parse_filter(const char *str, coom_filter dflt) {
+    for (int i = 0; i < COOM_FILTER_COUNT; ++i) {
+        if (strcmp(str, coom_filter_names[i]) == 0) return i;
+    }
+    coom_error("Unknown filter: '%s', expected nearest, bicubic, lanczos2 or lanczos3", str);
+    return dflt;
+}
+
 float parse_float(const char *str, float dflt) {
     errno        = 0;
     char *end    = NULL;
@@ -65,6 +83,12 @@ coom_config_t *coom_load_config(const char *file_path) {
         else if (sv_eq(key, "scroll_speed")) result->scroll_speed = parse_float(sv_to_cstr(value), default_config.scroll_speed);
         else if (sv_eq(key, "drag_friction")) result->drag_friction = parse_float(sv_to_cstr(value), default_config.drag_friction);
         else if (sv_eq(key, "scale_friction")) result->scale_friction = parse_float(sv_to_cstr(value), default_config.scale_friction);
+        else if (sv_eq(key, "history_budget")) result->history_budget = parse_float(sv_to_cstr(value), default_config.history_budget);
+        else if (sv_eq(key, "filter")) result->filter = parse_filter(sv_to_cstr(value), default_config.filter);
+        else if (sv_eq(key, "grid_scale")) result->grid_scale = parse_float(sv_to_cstr(value), default_config.grid_scale);
+        else if (sv_eq(key, "inspect_size")) result->inspect_size = parse_float(sv_to_cstr(value), default_config.inspect_size);
+        else if (sv_eq(key, "png_level")) result->png_level = parse_float(sv_to_cstr(value), default_config.png_level);
+        else if (sv_eq(key, "export_scale")) result->export_scale = parse_float(sv_to_cstr(value), default_config.export_scale);
         else coom_error("Unknown config key: `" SV_FMT "`", SV_ARG(key));
 
         temp_free(value.count);
@@ -89,6 +113,12 @@ bool coom_generate_default_config(const char *file_path) {
     fprintf(f, "scroll_speed = %.4f\n", default_config.scroll_speed);
     fprintf(f, "drag_friction = %.4f\n", default_config.drag_friction);
     fprintf(f, "scale_friction = %.4f\n", default_config.scale_friction);
+    fprintf(f, "history_budget = %.4f\n", default_config.history_budget);
+    fprintf(f, "filter = %s\n", coom_filter_name(default_config.filter));
+    fprintf(f, "grid_scale = %.4f\n", default_config.grid_scale);
+    fprintf(f, "inspect_size = %.4f\n", default_config.inspect_size);
+    fprintf(f, "png_level = %.4f\n", default_config.png_level);
+    fprintf(f, "export_scale = %.4f\n", default_config.export_scale);
 defer:
     temp_reset();
     if (f) fclose(f);
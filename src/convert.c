@@ -0,0 +1,142 @@
+#include "coomer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COOM_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+#define coom_convert_row(img, y) ((const u8 *)(img)->data + (usize)(y) * (img)->bytes_per_line)
+
+static const char *coom_convert_names[COOM_CONVERT_COUNT] = {"generic", "bgrx", "bgrx ssse3", "bgrx avx2"};
+
+const char *coom_convert_name(coom_convert convert) { return coom_convert_names[convert]; }
+
+// Generic path: any depth Xlib knows, channels found through the masks of the image.
+
+typedef struct {
+    int shift, bits;
+} coom_channel;
+
+static coom_channel coom_channel_of(unsigned long mask) {
+    if (mask == 0) return (coom_channel){0};
+    return (coom_channel){.shift = __builtin_ctzl(mask), .bits = __builtin_popcountl(mask)};
+}
+
+static inline u8 coom_channel_decode(unsigned long pixel, coom_channel ch) {
+    if (ch.bits == 0) return 0;
+    u32 value = (pixel >> ch.shift) & ((1ul << ch.bits) - 1);
+    return ch.bits >= 8 ? value >> (ch.bits - 8) : value * 255 / ((1u << ch.bits) - 1);
+}
+
+static void coom_rgb_row_generic(const XImage *img, int y, u8 *out) {
+    coom_channel r   = coom_channel_of(img->red_mask), g = coom_channel_of(img->green_mask), b = coom_channel_of(img->blue_mask);
+    const u8    *in  = coom_convert_row(img, y);
+    bool         msb = img->byte_order == MSBFirst;
+    for (int x = 0; x < img->width; ++x) {
+        unsigned long pixel;
+        // the common packed depths are read in place, the rest goes through Xlib
+        switch (img->bits_per_pixel) {
+            case 32: {
+                const u8 *p = in + x * 4;
+                pixel       = msb ? (u32)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3] : (u32)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+            } break;
+            case 24: {
+                const u8 *p = in + x * 3;
+                pixel       = msb ? (u32)p[0] << 16 | p[1] << 8 | p[2] : (u32)p[2] << 16 | p[1] << 8 | p[0];
+            } break;
+            case 16: {
+                const u8 *p = in + x * 2;
+                pixel       = msb ? p[0] << 8 | p[1] : p[1] << 8 | p[0];
+            } break;
+            default: pixel = XGetPixel((XImage *)img, x, y); break;
+        }
+        out[x * 3 + 0] = coom_channel_decode(pixel, r);
+        out[x * 3 + 1] = coom_channel_decode(pixel, g);
+        out[x * 3 + 2] = coom_channel_decode(pixel, b);
+    }
+}
+
+// BGRX path: 32 bits per pixel with blue in the lowest byte, what every 24/32-bit TrueColor
+// visual on a little endian server hands out.
+
+static void coom_bgrx_scalar(const u32 *in, u8 *out, usize n) {
+    for (usize i = 0; i < n; ++i) {
+        u32 p  = in[i];
+        out[0] = p >> 16;
+        out[1] = p >> 8;
+        out[2] = p;
+        out += 3;
+    }
+}
+
+static void coom_rgb_row_bgrx(const XImage *img, int y, u8 *out) { coom_bgrx_scalar((const u32 *)coom_convert_row(img, y), out, img->width); }
+
+#ifdef COOM_CONVERT_X86
+// 16 pixels into 48 bytes: each shuffle packs 4 pixels into the low 12 bytes, the shifts close
+// the gaps so every store is a full vector
+__attribute__((target("ssse3"))) static void coom_bgrx_ssse3(const u32 *in, u8 *out, usize n) {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    usize         i       = 0;
+    for (; i + 16 <= n; i += 16, out += 48) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i + 0)), shuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i + 4)), shuffle);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i + 8)), shuffle);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i + 12)), shuffle);
+        _mm_storeu_si128((__m128i *)(out + 0), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128((__m128i *)(out + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+    }
+    coom_bgrx_scalar(in + i, out, n - i);
+}
+
+__attribute__((target("ssse3"))) static void coom_rgb_row_ssse3(const XImage *img, int y, u8 *out) {
+    coom_bgrx_ssse3((const u32 *)coom_convert_row(img, y), out, img->width);
+}
+
+// 8 pixels per vector: the in-lane shuffle leaves 12 bytes at the bottom of each half, the
+// permute moves them together. The stores overlap by 8 bytes, the last one needs that much
+// room past the pixels it converts, the tail goes through the SSSE3 path.
+__attribute__((target("avx2"))) static void coom_bgrx_avx2(const u32 *in, u8 *out, usize n) {
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i pack    = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    usize         i       = 0;
+    for (; i + 32 + 3 <= n; i += 32, out += 96) {
+        for (int k = 0; k < 4; ++k) {
+            __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(in + i + k * 8)), shuffle);
+            _mm256_storeu_si256((__m256i *)(out + k * 24), _mm256_permutevar8x32_epi32(v, pack));
+        }
+    }
+    coom_bgrx_ssse3(in + i, out, n - i);
+}
+
+__attribute__((target("avx2"))) static void coom_rgb_row_avx2(const XImage *img, int y, u8 *out) {
+    coom_bgrx_avx2((const u32 *)coom_convert_row(img, y), out, img->width);
+}
+#endif
+
+static bool coom_is_bgrx(const XImage *img) {
+    bool little = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+    return img->bits_per_pixel == 32 && img->red_mask == 0xff0000 && img->green_mask == 0x00ff00 && img->blue_mask == 0x0000ff &&
+           img->byte_order == (little ? LSBFirst : MSBFirst);
+}
+
+coom_rgb_row_fn coom_rgb_row_converter(const XImage *img, coom_convert limit, coom_convert *picked) {
+    coom_convert    convert = COOM_CONVERT_GENERIC;
+    coom_rgb_row_fn fn      = coom_rgb_row_generic;
+    if (limit >= COOM_CONVERT_BGRX && coom_is_bgrx(img)) {
+        convert = COOM_CONVERT_BGRX;
+        fn      = coom_rgb_row_bgrx;
+#ifdef COOM_CONVERT_X86
+        if (limit >= COOM_CONVERT_SSSE3 && __builtin_cpu_supports("ssse3")) {
+            convert = COOM_CONVERT_SSSE3;
+            fn      = coom_rgb_row_ssse3;
+        }
+        if (limit >= COOM_CONVERT_AVX2 && __builtin_cpu_supports("avx2")) {
+            convert = COOM_CONVERT_AVX2;
+            fn      = coom_rgb_row_avx2;
+        }
+#endif
+    }
+    if (picked) *picked = convert;
+    return fn;
+}
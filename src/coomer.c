@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <time.h>
 
 #include "arg.h"
 
@@ -38,6 +39,13 @@ static void print_help(const char *program_name) {
     fprintf(stderr, "   -V, --version                 show the current version and exit\n");
     fprintf(stderr, "   -w, --windowed                windowed mode instead of fullscreen\n");
     fprintf(stderr, "   -s, --select                  select window mode default root window\n");
+    fprintf(stderr, "   -r, --region                  drag a rectangle on the screen and capture only that\n");
+    fprintf(stderr, "   -m, --monitor <name|index|cursor> capture and cover only one monitor\n");
+    fprintf(stderr, "   -l, --live                    keep refreshing the capture from the damaged parts of the screen\n");
+    fprintf(stderr, "       --loupe <size>            a round lens of <size> pixels that follows the pointer instead of the fullscreen zoom\n");
+    fprintf(stderr, "       --renderer <gl|soft>      draw with OpenGL or on the CPU, soft suits indirect GLX and VNC (default gl)\n");
+    fprintf(stderr, "       --vsync <on|off|adaptive> wait for vblank on swap, adaptive tears when a frame is late (default on)\n");
+    fprintf(stderr, "       --bench <name>            run a benchmark and exit, `--bench list` shows them\n");
     fprintf(stderr, "       --verbose                 make the output more verbose\n");
 }
 
@@ -53,8 +61,36 @@ bool parse_args(int *argc, char ***argv, options_args *optargs) {
         options_cmp_arg(opt, "-d",  "--delay",      { optargs->delay_second      = parse_float(arg, 0); });
         options_cmp_arg(opt, "-c",  "--config",     { optargs->config = arg; });
         options_cmp_arg(opt, "",    "--new-config", { optargs->new_config = arg; });
+        options_cmp_arg(opt, "-m",  "--monitor",    { optargs->monitor = arg; });
+        options_cmp_arg(opt, "",    "--bench",      { optargs->bench = arg; });
+        options_cmp_arg(opt, "",    "--loupe",      {
+            optargs->loupe = parse_float(arg, 0);
+            if (optargs->loupe <= 0) {
+                coom_error("loupe size must be a positive number of pixels, got '%s'", arg);
+                return false;
+            }
+        });
+        options_cmp_arg(opt, "",    "--renderer",   {
+            if (strcmp(arg, "gl") == 0) optargs->renderer = COOM_RENDERER_GL;
+            else if (strcmp(arg, "soft") == 0) optargs->renderer = COOM_RENDERER_SOFT;
+            else {
+                coom_error("unknown renderer '%s', expected gl or soft", arg);
+                return false;
+            }
+        });
+        options_cmp_arg(opt, "",    "--vsync",      {
+            if (strcmp(arg, "on") == 0) optargs->vsync = COOM_VSYNC_ON;
+            else if (strcmp(arg, "off") == 0) optargs->vsync = COOM_VSYNC_OFF;
+            else if (strcmp(arg, "adaptive") == 0) optargs->vsync = COOM_VSYNC_ADAPTIVE;
+            else {
+                coom_error("unknown vsync mode '%s', expected on, off or adaptive", arg);
+                return false;
+            }
+        });
         options_cmp(opt, "-w", "--windowed", { optargs->windowed = true; });
         options_cmp(opt, "-s", "--select", { optargs->select = true; });
+        options_cmp(opt, "-r", "--region", { optargs->region = true; });
+        options_cmp(opt, "-l", "--live", { optargs->live = true; });
         options_cmp(opt, "-h", "--help", {
             print_help(program_name);
             exit(0);
@@ -75,84 +111,225 @@ bool parse_args(int *argc, char ***argv, options_args *optargs) {
 static void coom_initialize_window(coom_t *c) {
     coom_info("%s", __PRETTY_FUNCTION__);
     coom_info("%s", __PRETTY_FUNCTION__);
-    int screen = XDefaultScreen(c->dpy);
-    int glxMajor, glxMinor;
-    if (!glXQueryVersion(c->dpy, &glxMajor, &glxMinor) || (glxMajor == 1 && glxMinor < 3) || (glxMajor < 1)) {
-        coom_error("Invalid GLX version. expected >=1.3");
-        exit(1);
-    }
-    coom_info("GLX Version   = %d.%d", glxMajor, glxMinor);
-    coom_info("GLX Extension = %s", glXQueryExtensionsString(c->dpy, screen));
+    int          screen = XDefaultScreen(c->dpy);
+    XVisualInfo *vi     = NULL;
+    Visual      *visual = DefaultVisual(c->dpy, screen);
+    int          depth  = DefaultDepth(c->dpy, screen);
+    if (c->renderer == COOM_RENDERER_GL) {
+        int glxMajor, glxMinor;
+        if (!glXQueryVersion(c->dpy, &glxMajor, &glxMinor) || (glxMajor == 1 && glxMinor < 3) || (glxMajor < 1)) {
+            coom_error("Invalid GLX version. expected >=1.3");
+            exit(1);
+        }
+        coom_info("GLX Version   = %d.%d", glxMajor, glxMinor);
+        coom_info("GLX Extension = %s", glXQueryExtensionsString(c->dpy, screen));
 
-    int          attr[] = {GLX_RGBA, GLX_DEPTH_SIZE, 24, GLX_DOUBLEBUFFER, None};
-    XVisualInfo *vi     = glXChooseVisual(c->dpy, 0, &attr[0]);
-    if (vi == NULL) {
-        coom_error("Failed to choose appropriate visual - glXChooseVisual");
-        exit(1);
+        int attr[] = {GLX_RGBA, GLX_DEPTH_SIZE, 24, GLX_DOUBLEBUFFER, None};
+        vi         = glXChooseVisual(c->dpy, 0, &attr[0]);
+        if (vi == NULL) {
+            coom_error("Failed to choose appropriate visual - glXChooseVisual");
+            exit(1);
+        }
+        coom_info("Visual %zu selected", vi->visualid);
+        visual = vi->visual;
+        depth  = vi->depth;
     }
-    coom_info("Visual %zu selected", vi->visualid);
 
     XSetWindowAttributes swa = {0};
-    swa.colormap             = XCreateColormap(c->dpy, DefaultRootWindow(c->dpy), vi->visual, AllocNone);
-    swa.event_mask           = (ButtonPressMask | ButtonReleaseMask | KeyPressMask | KeyReleaseMask | PointerMotionMask | ExposureMask | ClientMessage);
+    swa.colormap             = XCreateColormap(c->dpy, DefaultRootWindow(c->dpy), visual, AllocNone);
+    swa.event_mask           = (ButtonPressMask | ButtonReleaseMask | KeyPressMask | KeyReleaseMask | PointerMotionMask | ExposureMask | StructureNotifyMask |
+                      FocusChangeMask | ClientMessage);
     if (!c->windowed) {
         swa.override_redirect = 1;
         swa.save_under        = 1;
     }
-    XWindowAttributes attributes = {0};
-    XGetWindowAttributes(c->dpy, DefaultRootWindow(c->dpy), &attributes);
-    c->win = XCreateWindow(c->dpy, DefaultRootWindow(c->dpy), 0, 0, attributes.width, attributes.height, 0, vi->depth, InputOutput, vi->visual,
+    c->win = XCreateWindow(c->dpy, DefaultRootWindow(c->dpy), c->geom.x, c->geom.y, c->geom.w, c->geom.h, 0, depth, InputOutput, visual,
                            CWColormap | CWEventMask | CWOverrideRedirect | CWSaveUnder, &swa);
-    XMapWindow(c->dpy, c->win);
     XClassHint hint = {WM_NAME, WM_CLASS};
     XStoreName(c->dpy, c->win, WM_NAME);
     XSetClassHint(c->dpy, c->win, &hint);
 
     c->delete_msg = XInternAtom(c->dpy, "WM_DELETE_WINDOW", 0);
     XSetWMProtocols(c->dpy, c->win, &c->delete_msg, 1);
+    if (c->loupe.size > 0 && !coom_shape_circle(c->dpy, c->win, c->loupe.size)) coom_warning("no SHAPE extension, the loupe stays square");
 
+    if (c->renderer == COOM_RENDERER_SOFT) {
+        coom_soft_init(&c->soft, c->dpy, c->win);
+        return;
+    }
     GLXContext glc = glXCreateContext(c->dpy, vi, NULL, GL_TRUE);
     glXMakeCurrent(c->dpy, c->win, glc);
 }
 
 coom_t coom_init_coom(options_args args) {
     coom_info("%s", __PRETTY_FUNCTION__);
-    coom_t      c = {.quit = false, .windowed = args.windowed};
+    // the loupe is never managed, it has to stay glued to the pointer
+    coom_t      c = {.quit = false, .windowed = args.windowed && args.loupe == 0, .renderer = args.renderer};
     const char *cfgpath;
     if (args.config != NULL) cfgpath = args.config;
     else cfgpath = get_config_path("coomer", "config.cfg");
 
-    c.cfg  = coom_load_config(cfgpath);
-    c.dpy  = coom_open_display();
-    c.img  = coom_new_screenshot(c.dpy, (args.select) ? coom_select_window(c.dpy) : DefaultRootWindow(c.dpy));
+    f64 start = coom_time_now();
+    c.cfg     = coom_load_config(cfgpath);
+    XInitThreads();
+    c.dpy    = coom_open_display();
+    c.target = (args.select) ? coom_select_window(c.dpy) : DefaultRootWindow(c.dpy);
+    c.area   = coom_window_rect(c.dpy, c.target);
+    c.geom   = coom_window_rect(c.dpy, DefaultRootWindow(c.dpy));
+    if (args.monitor != NULL && coom_find_monitor(c.dpy, args.monitor, &c.geom)) {
+        // monitors are in root coordinates, a selected window is still captured whole
+        if (c.target == DefaultRootWindow(c.dpy)) c.area = c.geom;
+    }
+    coom_rect region = {0};
+    if (args.region && coom_select_region(c.dpy, &region)) {
+        c.target = DefaultRootWindow(c.dpy);
+        c.area   = region;
+        coom_info("region %dx%d+%d+%d", region.w, region.h, region.x, region.y);
+    }
+    if (args.loupe > 0) {
+        int    x, y;
+        Window child;
+        XTranslateCoordinates(c.dpy, c.target, DefaultRootWindow(c.dpy), c.area.x, c.area.y, &x, &y, &child);
+        c.loupe = (coom_loupe){.size = args.loupe, .pointer = coom_mouse_pos(c.dpy), .origin = vec2(x, y)};
+        c.geom  = (coom_rect){.x = c.loupe.pointer.x - args.loupe / 2, .y = c.loupe.pointer.y - args.loupe / 2, .w = args.loupe, .h = args.loupe};
+    }
+    if (args.live) {
+        if (c.target == DefaultRootWindow(c.dpy) && !c.windowed)
+            coom_warning("live capture of the root window under a fullscreen zoom also captures the zoom itself, consider --windowed or --select");
+        // created before the capture, so anything drawn while it runs is picked up on the first frame
+        c.live.damage = coom_new_damage(c.dpy, c.target, &c.live.event_base);
+    }
+
+    // capture and GL context creation only meet at the texture upload
+    coom_capture capture = {.target = c.target, .area = c.area};
+    coom_capture_start(&capture);
+
     c.rate = coom_get_monitor_rate(c.dpy);
     c.dt   = 1.0 / c.rate;
-
     coom_initialize_window(&c);
+    coom_clipboard_init(&c.clipboard, c.dpy);
+    coom_exporter_init(&c.exporter, c.win);
+    // without swap control the swap may not block, sleep to the refresh rate so animations do not spin a core
+    bool swap_control = c.renderer == COOM_RENDERER_GL && coom_set_swap_interval(c.dpy, c.win, args.vsync);
+    c.paced           = !swap_control && args.vsync != COOM_VSYNC_OFF;
+    if (c.paced) coom_info("pacing frames to %d Hz with sleeps", c.rate);
+    if (c.renderer == COOM_RENDERER_GL) {
+        coom_initialize_texture(&c.tex, c.area.w, c.area.h);
+        coom_initialize_shader(&c.shaders, &c.vao, &c.vbo, &c.ebo, &c.ubo, &c.tex);
+        coom_gpu_timer_init(&c.timer);
+    }
 
-    c.prog     = coom_initialize_shader(&c.vao, &c.vbo, &c.ebo, c.img);
+    // mapping before the capture finished would put the zoom window itself into the screenshot
+    c.img = coom_capture_join(c.dpy, &capture);
+    XMapWindow(c.dpy, c.win);
+    if (args.monitor != NULL) {
+        usize full = coom_rect_bytes(coom_window_rect(c.dpy, DefaultRootWindow(c.dpy)), c.img->bits_per_pixel);
+        usize used = (usize)c.img->bytes_per_line * c.img->height;
+        coom_info("monitor capture: %zu bytes, %zu bytes saved against the full root", used, full > used ? full - used : 0);
+    }
+    if (c.renderer == COOM_RENDERER_GL) {
+        coom_upload_texture(&c.tex, c.img);
+    } else {
+        ASSERT_EXIT(c.img->bits_per_pixel == 32, 1, "software renderer needs a 32-bit capture, got %d bits per pixel", c.img->bits_per_pixel);
+    }
+    if (c.live.damage != None && c.cfg->history_budget > 0) coom_history_init(&c.live.history, c.img, c.cfg->history_budget * 1024 * 1024);
+    coom_info("startup took %.2f ms", (coom_time_now() - start) * 1000.0);
 
-    c.cam      = (coom_camera){.scale = 1.0};
-    vec2_t pos = coom_mouse_pos(c.dpy);
+    c.cam      = (coom_camera){.scale = c.loupe.size > 0 ? COOM_LOUPE_SCALE : 1.0};
+    vec2_t pos = vec2_sub(coom_mouse_pos(c.dpy), vec2(c.geom.x, c.geom.y));
     c.mouse    = (coom_mouse){.curr = pos, .prev = pos};
     c.fl       = (coom_flashlight){.enabled = false, .radius = 200.0};
+    c.filter   = c.cfg->filter;
+    c.dirty    = true;
+    c.winsize  = vec2(c.geom.w, c.geom.h);
+    c.resized  = true;
 
     return c;
 }
 
 void coom_uninit_coom(coom_t *c) {
     coom_info("%s", __PRETTY_FUNCTION__);
-    coom_uninitialize_shader(&c->vao, &c->vbo, &c->ebo, &c->prog);
-    coom_delete_screenshot(c->img);
+    // before anything the queued exports read from, the capture, the history and the thread pool
+    coom_exporter_uninit(&c->exporter, c->dpy);
+    coom_history_uninit(&c->live.history);
+    coom_delete_damage(c->dpy, c->live.damage);
+    if (c->renderer == COOM_RENDERER_SOFT) {
+        coom_soft_uninit(&c->soft, c->dpy);
+    } else {
+        coom_gpu_timer_uninit(&c->timer);
+        coom_uninitialize_texture(&c->tex);
+        coom_uninitialize_shader(&c->shaders, &c->vao, &c->vbo, &c->ebo, &c->ubo);
+    }
+    coom_inspector_uninit(&c->inspector, c->dpy);
+    coom_delete_screenshot(c->dpy, c->img);
     if (c->dpy) XCloseDisplay(c->dpy);
+    // the selection dies with our window, a child process picks it up on its own connection
+    coom_clipboard_persist(&c->clipboard);
+    coom_clipboard_uninit(&c->clipboard);
     coom_unload_config(c->cfg);
 }
 
+static void coom_scrub_history(coom_t *c, int direction) {
+    coom_rect r = {0};
+    if (!coom_history_step(&c->live.history, c->img, direction, &r)) return;
+    coom_exporter_invalidate(&c->exporter);
+    coom_update_texture(&c->tex, c->live.history.view, r.x, r.y, r.w, r.h);
+}
+
+// queues the capture in full resolution, the history view while scrubbing. with `view` only what
+// the window shows, at the current zoom times export_scale
+static void coom_save_capture(coom_t *c, bool view) {
+    XImage             *img = c->live.history.cursor > 0 ? c->live.history.view : c->img;
+    coom_export_request req = {.level = c->cfg->png_level, .view = view, .cam = c->cam, .winsize = c->winsize, .scale = c->cfg->export_scale};
+    time_t              now = time(NULL);
+    strftime(req.path, sizeof(req.path), view ? "coomer-%Y%m%d-%H%M%S-view.png" : "coomer-%Y%m%d-%H%M%S.png", localtime(&now));
+    // a --live capture keeps changing under the worker, a still one is only pinned
+    coom_exporter_submit(&c->exporter, img, c->live.damage != None, &req);
+}
+
+// the zoomed view as an image on the clipboard, encoded only when someone pastes it
+static void coom_copy_view(coom_t *c, Time time) {
+    XImage *img  = c->live.history.cursor > 0 ? c->live.history.view : c->img;
+    XImage *view = coom_export_view(img, &c->cam, c->winsize, c->cfg->export_scale);
+    if (view == NULL) return;
+    int width = view->width, height = view->height;
+    if (coom_clipboard_set_image(&c->clipboard, c->dpy, c->win, view, c->cfg->png_level, time)) coom_info("copied the %dx%d view", width, height);
+}
+
 static void coom_process_events(coom_t *c, XEvent ev) {
     switch (ev.type) {
-        case Expose: break;
+        case Expose:
+            if (ev.xexpose.window == c->inspector.overlay.win) c->inspector.stale = true;
+            else if (ev.xexpose.window == c->exporter.overlay.win) c->exporter.redraw = true;
+            else c->dirty = true;
+            break;
+        case ConfigureNotify:
+            if (ev.xconfigure.width == c->winsize.x && ev.xconfigure.height == c->winsize.y) break;
+            c->winsize = vec2(ev.xconfigure.width, ev.xconfigure.height);
+            c->resized = c->dirty = true;
+            break;
+        case MapNotify:
+            // the loupe sits under the pointer, grab it so the motion keeps coming when it moves faster than us
+            if (c->loupe.size > 0)
+                XGrabPointer(c->dpy, c->win, False, PointerMotionMask | ButtonPressMask | ButtonReleaseMask, GrabModeAsync, GrabModeAsync, None, None,
+                             CurrentTime);
+            // fallthrough
+        case FocusOut:
+            // override-redirect gets no focus from the window manager, take it back when lost
+            if (c->windowed || (ev.type == FocusOut && ev.xfocus.mode == NotifyGrab)) break;
+            XSetInputFocus(c->dpy, c->win, RevertToParent, CurrentTime);
+            break;
         case MotionNotify: {
+            // the overlay is redrawn on its own, hovering alone never costs a frame
+            c->inspector.stale = c->inspector.enabled;
+            if (c->loupe.size > 0) {
+                c->loupe.pointer = vec2(ev.xmotion.x_root, ev.xmotion.y_root);
+                c->loupe.moved = c->dirty = true;
+                break;
+            }
             c->mouse.curr = vec2(ev.xmotion.x, ev.xmotion.y);
+            // the cursor is only visible through the flashlight
+            if (c->mouse.drag || c->fl.shadow > 0.0) c->dirty = true;
             if (c->mouse.drag) {
                 vec2_t prev  = coom_camera_world(c->cam, c->mouse.prev);
                 vec2_t curr  = coom_camera_world(c->cam, c->mouse.curr);
@@ -164,17 +341,41 @@ static void coom_process_events(coom_t *c, XEvent ev) {
         } break;
         case ClientMessage: c->quit = ((Atom)ev.xclient.data.l[0]) == c->delete_msg; break;
         case KeyPress:
+            c->dirty = true;
             switch (XLookupKeysym((XKeyEvent *)&ev, 0)) {
                 case XK_equal: coom_camera_scrollup(c); break;
                 case XK_minus: coom_camera_scrolldown(c); break;
                 case XK_0: coom_camera_reset(c); break;
                 case XK_f: c->fl.enabled = !c->fl.enabled; break;
+                case XK_i:
+                    c->filter      = (c->filter + 1) % COOM_FILTER_COUNT;
+                    c->late_frames = 0;
+                    coom_info("filter: %s", coom_filter_name(c->filter));
+                    break;
+                case XK_p: coom_inspector_toggle(&c->inspector, c->dpy, c->win, c->cfg->inspect_size); break;
+                case XK_c: {
+                    if (ev.xkey.state & ControlMask) {
+                        coom_copy_view(c, ev.xkey.time);
+                        break;
+                    }
+                    if (!c->inspector.enabled || !c->inspector.inside) break;
+                    // shift copies the average of the square instead
+                    const char *hex = coom_inspector_hex(&c->inspector, (ev.xkey.state & ShiftMask) != 0);
+                    if (coom_clipboard_set_text(&c->clipboard, c->dpy, c->win, hex, ev.xkey.time)) coom_info("copied %s", hex);
+                } break;
+                case XK_s:
+                    // shift exports the zoomed view instead
+                    coom_save_capture(c, (ev.xkey.state & ShiftMask) != 0);
+                    break;
+                case XK_comma: coom_scrub_history(c, -1); break;
+                case XK_period: coom_scrub_history(c, 1); break;
                 case XK_q:
                 case XK_Escape: c->quit = true; break;
                 default: break;
             }
             break;
         case ButtonPress:
+            c->dirty = true;
             switch (ev.xbutton.button) {
                 case Button1:
                     c->mouse.prev   = c->mouse.curr;
@@ -186,29 +387,132 @@ static void coom_process_events(coom_t *c, XEvent ev) {
                 default: break;
             }
             break;
-        default: break;
+        default:
+            if (coom_clipboard_handle(&c->clipboard, c->dpy, &ev)) break;
+            if (c->live.damage != None && ev.type == c->live.event_base + XDamageNotify) c->live.pending = c->dirty = true;
+            else if (c->soft.completion != 0 && ev.type == c->soft.completion) c->soft.busy = false;
+            break;
     }
 }
 
-void coom_begin(coom_t *c) {
-    if (!c->windowed) XSetInputFocus(c->dpy, c->win, RevertToParent, CurrentTime);
-    XWindowAttributes attr = {0};
-    XGetWindowAttributes(c->dpy, c->win, &attr);
-    glViewport(0, 0, attr.width, attr.height);
-    c->winsize = vec2(attr.width, attr.height);
+vec2_t coom_camera_image(const coom_camera *cam, vec2_t winsize, int width, int height, vec2_t p) {
+    f32 x = cam->position.x + (width - winsize.x / cam->scale) * 0.5, y = cam->position.y + (height - winsize.y / cam->scale) * 0.5;
+    return vec2(x + p.x / cam->scale, y + p.y / cam->scale);
+}
+
+// read the hovered pixel from the image on screen, the history view while scrubbing
+static void coom_inspect(coom_t *c) {
+    XImage *img = c->live.history.cursor > 0 ? c->live.history.view : c->img;
+    // the hotspot covers a whole window pixel, take its center like the renderers do
+    vec2_t  p   = coom_camera_image(&c->cam, c->winsize, img->width, img->height, vec2_add(c->mouse.curr, vec2(0.5, 0.5)));
+    coom_inspector_update(&c->inspector, c->dpy, img, floorf(p.x), floorf(p.y));
+}
 
+void coom_begin(coom_t *c) {
+    // nothing moves and nothing was damaged, sleep until the server has something for us
     XEvent ev;
-    while (XPending(c->dpy) > 0) {
-        XNextEvent(c->dpy, &ev);
-        if (XFilterEvent(&ev, None)) continue;
-        coom_process_events(c, ev);
+    bool   waited = false;
+    for (;;) {
+        while (XPending(c->dpy) > 0) {
+            XNextEvent(c->dpy, &ev);
+            if (XFilterEvent(&ev, None)) continue;
+            coom_process_events(c, ev);
+        }
+        if (c->inspector.stale) coom_inspect(c);
+        int timeout = coom_exporter_update(&c->exporter, c->dpy);
+        if (c->dirty || c->quit) break;
+        // the export worker wakes us for its overlay, the overlay for its own timeout
+        coom_wait_display(c->dpy, c->exporter.started ? c->exporter.pipe[0] : -1, timeout);
+        waited = true;
+    }
+    // physics follows the real frame time, the first frame after an idle wait takes a nominal step
+    f64 now        = coom_time_now();
+    c->dt          = (waited || c->frame_start == 0.0) ? 1.0 / c->rate : fmin(now - c->frame_start, COOM_MAX_DT);
+    c->frame_start = now;
+    if (c->loupe.moved) {
+        // only the latest position matters, a burst of motion events moves the window once
+        c->loupe.moved = false;
+        XMoveWindow(c->dpy, c->win, c->loupe.pointer.x - c->loupe.size / 2, c->loupe.pointer.y - c->loupe.size / 2);
+    }
+    if (c->resized) {
+        c->resized = false;
+        if (c->renderer == COOM_RENDERER_SOFT) {
+            ASSERT_EXIT(coom_soft_resize(&c->soft, c->dpy, c->winsize.x, c->winsize.y), 1, "Failed to create the software back buffer");
+        } else {
+            COOM_GL(glViewport(0, 0, c->winsize.x, c->winsize.y));
+        }
+    }
+    if (c->live.pending) {
+        c->live.pending      = false;
+        coom_history *h      = c->live.history.arena ? &c->live.history : NULL;
+        usize         pixels = coom_refresh_damage(c->dpy, c->live.damage, c->target, c->area, c->img, &c->tex, h);
+        coom_exporter_invalidate(&c->exporter);
+        coom_info("live: refreshed %zu of %zu pixels", pixels, (usize)c->img->width * c->img->height);
+    }
+    if (c->live.history.resync) {
+        c->live.history.resync = false;
+        coom_update_texture(&c->tex, c->img, 0, 0, c->img->width, c->img->height);
+    }
+}
+
+static void coom_report_stats(coom_t *c) {
+    c->stats.frames += 1;
+    c->stats.gl_calls += coom_gl_calls;
+    c->stats.round_trips += coom_x_round_trips;
+    coom_gl_calls = coom_x_round_trips = 0;
+    if (!verbose) return;
+
+    // an idle stretch ends up in the window of the first frame after it
+    f64 now = coom_time_now(), cpu = coom_cpu_time();
+    if (c->stats.since == 0.0) c->stats = (coom_stats){.since = now, .cpu = cpu};
+    f64 elapsed = now - c->stats.since;
+    if (elapsed < 1.0) return;
+    coom_info("%.1f fps, %.1f GL calls/frame, %.2f X round trips/frame, %.1f%% cpu", c->stats.frames / elapsed, (f64)c->stats.gl_calls / c->stats.frames,
+              (f64)c->stats.round_trips / c->stats.frames, (cpu - c->stats.cpu) / elapsed * 100.0);
+    for (int i = 0; i < COOM_SHADER_VARIANTS; ++i) {
+        if (c->timer.frames[i] == 0) continue;
+        coom_info("  %-24s shader: %.3f ms gpu/frame over %llu frames", coom_shader_variant_name(i), c->timer.time[i] / 1e6 / c->timer.frames[i],
+                  (unsigned long long)c->timer.frames[i]);
+        c->timer.time[i] = c->timer.frames[i] = 0;
     }
+    c->stats = (coom_stats){.since = now, .cpu = cpu};
 }
 
 void coom_end(coom_t *c) {
-    glXSwapBuffers(c->dpy, c->win);
-    glFlush();
-    XSync(c->dpy, 0);
+    // the swap flushes, the server catches up with the rest at the next XPending
+    if (c->renderer == COOM_RENDERER_SOFT) coom_soft_present(&c->soft, c->dpy, c->win);
+    else glXSwapBuffers(c->dpy, c->win);
+    // the camera may have moved under a still pointer
+    if (c->inspector.enabled) coom_inspect(c);
+    if (c->paced) coom_sleep_until(c->frame_start + 1.0 / c->rate);
+    coom_report_stats(c);
+}
+
+coom_rect coom_camera_visible(const coom_camera *cam, vec2_t winsize, int width, int height) {
+    // inverse of the vertex shader, the window center shows the capture center shifted by the camera
+    f32 w = winsize.x / cam->scale, h = winsize.y / cam->scale;
+    f32 x = cam->position.x + (width - w) * 0.5, y = cam->position.y + (height - h) * 0.5;
+    return (coom_rect){.x = floorf(x), .y = floorf(y), .w = ceilf(w) + 1, .h = ceilf(h) + 1};
+}
+
+// a frame this much longer than the refresh interval missed its vblank
+#define COOM_FILTER_LATE   1.25
+#define COOM_FILTER_MISSES 8
+
+// steps the filter down when it keeps missing the refresh budget, until the next `i` press
+static void coom_filter_budget(coom_t *c, bool magnified) {
+    if (!magnified || c->filter == COOM_FILTER_NEAREST) {
+        c->late_frames = 0;
+        return;
+    }
+    // dt is nominal after an idle wait, only back to back frames say anything about the cost
+    if (c->dt > COOM_FILTER_LATE / c->rate) c->late_frames += 1;
+    else c->late_frames = 0;
+    if (c->late_frames < COOM_FILTER_MISSES) return;
+    coom_warning("%.2f ms frames miss the %.2f ms refresh budget with %s, falling back to %s", c->dt * 1000.0, 1000.0 / c->rate,
+                 coom_filter_name(c->filter), coom_filter_name(c->filter - 1));
+    c->filter -= 1;
+    c->late_frames = 0;
 }
 
 void coom_draw(coom_t *c) {
@@ -231,6 +535,15 @@ void coom_draw(coom_t *c) {
         vec2_add_assign(&c->cam.velocity, velocty_friction);
     }
 
+    if (c->loupe.size > 0) {
+        // the lens never pans, it centres the capture pixel under the pointer and zooms around it
+        vec2_t under       = vec2_sub(vec2_add(c->loupe.pointer, vec2(0.5, 0.5)), c->loupe.origin);
+        c->cam.position    = vec2_sub(under, vec2(c->img->width * 0.5, c->img->height * 0.5));
+        c->cam.velocity    = vec2(0.0, 0.0);
+        c->mouse.curr      = vec2_mulf(c->winsize, 0.5);
+        c->cam.scale_pivot = c->mouse.curr;
+    }
+
     if (fabsf(c->fl.delta_radius) > 1.0) {
         c->fl.radius = fmaxf(0.0, c->fl.radius + c->fl.delta_radius * c->dt);
         c->fl.delta_radius -= c->fl.delta_radius * 10.0 * c->dt;
@@ -238,16 +551,41 @@ void coom_draw(coom_t *c) {
     if (c->fl.enabled) c->fl.shadow = fminf(c->fl.shadow + 6.0 * c->dt, 0.8);
     else c->fl.shadow = fmaxf(c->fl.shadow - 6.0 * c->dt, 0.0);
 
-    glClearColor(0.1, 0.1, 0.1, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(c->prog);
-    glUniform2f(glGetUniformLocation(c->prog, "cameraPos"), c->cam.position.x, c->cam.position.y);
-    glUniform1f(glGetUniformLocation(c->prog, "cameraScale"), c->cam.scale);
-    glUniform2f(glGetUniformLocation(c->prog, "screenshotSize"), c->img->width, c->img->height);
-    glUniform2f(glGetUniformLocation(c->prog, "windowSize"), c->winsize.x, c->winsize.y);
-    glUniform2f(glGetUniformLocation(c->prog, "cursorPos"), c->mouse.curr.x, c->mouse.curr.y);
-    glUniform1f(glGetUniformLocation(c->prog, "flShadow"), c->fl.shadow);
-    glUniform1f(glGetUniformLocation(c->prog, "flRadius"), c->fl.radius);
-    glBindVertexArray(c->vao);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL);
+    // keep drawing while something is still in motion
+    bool animating = fabs(c->cam.deltascale) > 0.5 || (!c->mouse.drag && vec2_lenght(c->cam.velocity) > VELOCITY_THRESHOLD) ||
+                     fabsf(c->fl.delta_radius) > 1.0 || (c->fl.enabled ? c->fl.shadow < 0.8 : c->fl.shadow > 0.0);
+
+    if (c->renderer == COOM_RENDERER_SOFT) {
+        // while scrubbing the history view is shown, the GL path has it in the texture instead
+        XImage *src = c->live.history.cursor > 0 ? c->live.history.view : c->img;
+        coom_soft_wait(&c->soft, c->dpy);
+        coom_soft_draw(c->soft.back, src, &c->cam, c->mouse.curr, &c->fl);
+        c->dirty = animating;
+        return;
+    }
+
+    // program, vao and clear color are bound once by coom_initialize_shader
+    COOM_GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    coom_frame_uniforms frame = {
+        .camera_pos      = c->cam.position,
+        .window_size     = c->winsize,
+        .screenshot_size = vec2(c->img->width, c->img->height),
+        .cursor_pos      = c->mouse.curr,
+        .camera_scale    = c->cam.scale,
+        .fl_shadow       = c->fl.shadow,
+        .fl_radius       = c->fl.radius,
+    };
+    coom_update_uniforms(c->ubo, &c->uniforms, &frame);
+    bool mipmapping = coom_update_texture_filter(&c->tex, c->cam.scale);
+    c->dirty        = animating || mipmapping;
+
+    // at 1x and below a filter has nothing to reconstruct, the flashlight costs nothing until it fades in
+    bool magnified = c->cam.scale > 1.0;
+    coom_filter_budget(c, magnified);
+    int overlays = (c->fl.shadow > 0.0 ? COOM_SHADER_FLASHLIGHT : 0) | (c->cfg->grid_scale > 0.0 && c->cam.scale >= c->cfg->grid_scale ? COOM_SHADER_GRID : 0);
+    int variant  = COOM_SHADER_VARIANT(overlays, c->cam.scale < 1.0, magnified ? c->filter : COOM_FILTER_NEAREST);
+    if (variant != c->shaders.bound) coom_use_shader(&c->shaders, variant);
+    coom_gpu_timer_begin(&c->timer, variant);
+    coom_draw_texture(&c->tex, coom_camera_visible(&c->cam, c->winsize, c->img->width, c->img->height));
+    coom_gpu_timer_end(&c->timer);
 }
@@ -0,0 +1,81 @@
+#include "coomer.h"
+
+static EGLDisplay coom_egl_display(void) {
+    // the surfaceless platform never looks at $DISPLAY, the default one tries X11 first
+    const char *client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (coom_has_extension(client, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display != NULL) {
+            EGLDisplay dpy = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            if (dpy != EGL_NO_DISPLAY) return dpy;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool coom_egl_begin(coom_egl *egl, int width, int height) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    *egl = (coom_egl){.dpy = coom_egl_display(), .ctx = EGL_NO_CONTEXT, .surface = EGL_NO_SURFACE, .width = width, .height = height};
+    EGLint major, minor;
+    if (egl->dpy == EGL_NO_DISPLAY || !eglInitialize(egl->dpy, &major, &minor)) {
+        coom_error("EGL: failed to initialize a display");
+        egl->dpy = EGL_NO_DISPLAY;
+        return false;
+    }
+    coom_info("EGL Version   = %d.%d (%s)", major, minor, eglQueryString(egl->dpy, EGL_VENDOR));
+
+    bool      surfaceless = coom_has_extension(eglQueryString(egl->dpy, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+    EGLint    attr[]      = {EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint    count = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(egl->dpy, attr, &config, 1, &count) || count == 0) {
+        coom_error("EGL: no config for desktop OpenGL");
+        coom_egl_end(egl);
+        return false;
+    }
+    egl->ctx = eglCreateContext(egl->dpy, config, EGL_NO_CONTEXT, NULL);
+    if (egl->ctx == EGL_NO_CONTEXT) {
+        coom_error("EGL: failed to create a context - 0x%x", eglGetError());
+        coom_egl_end(egl);
+        return false;
+    }
+    if (!surfaceless) {
+        // only there to make the context current, nothing is drawn into it
+        EGLint pbuffer[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        egl->surface     = eglCreatePbufferSurface(egl->dpy, config, pbuffer);
+    }
+    if (!eglMakeCurrent(egl->dpy, egl->surface, egl->surface, egl->ctx)) {
+        coom_error("EGL: failed to make the context current - 0x%x", eglGetError());
+        coom_egl_end(egl);
+        return false;
+    }
+    coom_info("EGL %s context, GL renderer: %s", surfaceless ? "surfaceless" : "pbuffer", glGetString(GL_RENDERER));
+
+    glGenRenderbuffers(1, &egl->color);
+    glBindRenderbuffer(GL_RENDERBUFFER, egl->color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenFramebuffers(1, &egl->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, egl->fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, egl->color);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        coom_error("EGL: %dx%d framebuffer is incomplete", width, height);
+        coom_egl_end(egl);
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void coom_egl_end(coom_egl *egl) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    if (egl->dpy == EGL_NO_DISPLAY) return;
+    if (egl->ctx != EGL_NO_CONTEXT) {
+        glDeleteFramebuffers(1, &egl->fbo);
+        glDeleteRenderbuffers(1, &egl->color);
+        eglMakeCurrent(egl->dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(egl->dpy, egl->ctx);
+    }
+    if (egl->surface != EGL_NO_SURFACE) eglDestroySurface(egl->dpy, egl->surface);
+    eglTerminate(egl->dpy);
+    *egl = (coom_egl){.dpy = EGL_NO_DISPLAY};
+}
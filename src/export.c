@@ -0,0 +1,251 @@
+#include "coomer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// the overlay stays up this long after the last export finished
+#define COOM_EXPORT_LINGER 3.0
+// widest line the overlay ever shows, sizes the window once
+#define COOM_EXPORT_WIDEST "failed coomer-20261018-120000-view.png"
+
+struct coom_export_job {
+    coom_export_job    *next;
+    coom_export_request req;
+    coom_export_source *source;
+};
+
+// an export wider or taller than this is a mistake in export_scale, not a picture
+#define COOM_EXPORT_MAX_SIDE 32768
+
+// 32-bit image in the format of `src` with pixels of our own, no server side
+static XImage *coom_export_image(const XImage *src, int width, int height) {
+    XImage *img = coom_alloc(NULL, sizeof(XImage));
+    *img        = *src;
+    img->width          = width;
+    img->height         = height;
+    img->xoffset        = 0;
+    img->bytes_per_line = width * 4;
+    img->obdata         = NULL;
+    img->data           = coom_alloc(NULL, (usize)img->bytes_per_line * height);
+    ASSERT_EXIT(XInitImage(img) != 0, 1, "Failed to initialize export image");
+    return img;
+}
+
+XImage *coom_export_view(const XImage *src, const coom_camera *cam, vec2_t winsize, f32 scale) {
+    if (src->bits_per_pixel != 32) {
+        coom_error("view export needs a 32-bit capture, got %d bits per pixel", src->bits_per_pixel);
+        return NULL;
+    }
+    // the window corners in the capture, clipped to it so the background is never exported
+    vec2_t a  = coom_camera_image(cam, winsize, src->width, src->height, vec2(0.0, 0.0));
+    vec2_t b  = coom_camera_image(cam, winsize, src->width, src->height, winsize);
+    f32    x0 = fmaxf(a.x, 0.0), y0 = fmaxf(a.y, 0.0);
+    f32    x1 = fminf(b.x, src->width), y1 = fminf(b.y, src->height);
+    if (x1 <= x0 || y1 <= y0) {
+        coom_warning("nothing of the capture is in view, no export");
+        return NULL;
+    }
+
+    coom_camera out = {.scale = cam->scale * scale};
+    f32         w = (x1 - x0) * out.scale, h = (y1 - y0) * out.scale;
+    if (w > COOM_EXPORT_MAX_SIDE || h > COOM_EXPORT_MAX_SIDE) {
+        coom_error("view export of %.0fx%.0f is too large, lower export_scale", w, h);
+        return NULL;
+    }
+    int width = w < 1.0 ? 1 : w, height = h < 1.0 ? 1 : h;
+
+    // a camera that puts the clipped rectangle exactly on the output, the soft renderer does the
+    // rest: rows on the thread pool, nearest while magnifying and SSE2 bilinear below 1x
+    out.position.x = x0 - (src->width - width / out.scale) * 0.5;
+    out.position.y = y0 - (src->height - height / out.scale) * 0.5;
+    XImage *img    = coom_export_image(src, width, height);
+    coom_soft_draw(img, src, &out, vec2(0.0, 0.0), &(coom_flashlight){0});
+    return img;
+}
+
+// the worker and the render loop both let go of sources, called with the lock held
+static void coom_export_release(coom_export_source *source) {
+    if (--source->refs > 0) return;
+    if (source->owned) coom_delete_screenshot(NULL, source->img);
+    coom_free(source);
+}
+
+static void coom_export_notify(coom_exporter *ex) {
+    ex->serial += 1;
+    // a full pipe already wakes the render loop, the byte can be dropped
+    if (write(ex->pipe[1], "", 1) < 0 && errno != EAGAIN) coom_warning("export: failed to wake the render loop - %s", strerror(errno));
+}
+
+static void coom_export_progress(void *ctx, f32 done) {
+    coom_exporter *ex = ctx;
+    pthread_mutex_lock(&ex->lock);
+    ex->progress = done;
+    coom_export_notify(ex);
+    pthread_mutex_unlock(&ex->lock);
+}
+
+static bool coom_export_run(coom_exporter *ex, coom_export_job *job) {
+    const coom_export_request *req   = &job->req;
+    f64                        start = coom_time_now();
+    XImage                    *img   = job->source->img;
+    if (req->view) {
+        img = coom_export_view(img, &req->cam, req->winsize, req->scale);
+        if (img == NULL) return false;
+    }
+    bool saved = coom_save_to_png(img, req->path, req->level, coom_export_progress, ex);
+    if (saved) coom_info("saved %dx%d %s to %s in %.2f ms", img->width, img->height, req->view ? "view" : "capture", req->path, (coom_time_now() - start) * 1000.0);
+    if (req->view) coom_delete_screenshot(NULL, img);
+    return saved;
+}
+
+static void *coom_export_worker(void *arg) {
+    coom_exporter *ex = arg;
+    pthread_mutex_lock(&ex->lock);
+    for (;;) {
+        // the queue is emptied before quitting, nothing asked for is lost
+        while (!ex->quit && ex->head == NULL) pthread_cond_wait(&ex->wake, &ex->lock);
+        coom_export_job *job = ex->head;
+        if (job == NULL) break;
+        ex->progress = 0.0;
+        coom_export_notify(ex);
+        pthread_mutex_unlock(&ex->lock);
+
+        bool saved = coom_export_run(ex, job);
+
+        pthread_mutex_lock(&ex->lock);
+        ex->head = job->next;
+        if (ex->head == NULL) ex->tail = NULL;
+        ex->pending -= 1;
+        ex->last_ok  = saved;
+        snprintf(ex->last, sizeof(ex->last), "%s", job->req.path);
+        coom_export_release(job->source);
+        coom_export_notify(ex);
+        coom_free(job);
+    }
+    pthread_mutex_unlock(&ex->lock);
+    return NULL;
+}
+
+bool coom_exporter_init(coom_exporter *ex, Window parent) {
+    *ex = (coom_exporter){.parent = parent, .hide_at = -1.0};
+    if (pipe(ex->pipe) < 0) {
+        coom_error("export: failed to create the wake pipe - %s", strerror(errno));
+        return false;
+    }
+    for (int i = 0; i < 2; ++i) fcntl(ex->pipe[i], F_SETFL, fcntl(ex->pipe[i], F_GETFL) | O_NONBLOCK);
+    pthread_mutex_init(&ex->lock, NULL);
+    pthread_cond_init(&ex->wake, NULL);
+    if (pthread_create(&ex->thread, NULL, coom_export_worker, ex) != 0) {
+        coom_error("export: failed to start the worker thread");
+        coom_exporter_uninit(ex, NULL);
+        return false;
+    }
+    ex->started = true;
+    return true;
+}
+
+// private copy of any XImage, same layout
+static XImage *coom_export_copy(const XImage *src) {
+    XImage *img = coom_alloc(NULL, sizeof(XImage));
+    usize   size = (usize)src->bytes_per_line * src->height;
+    *img        = *src;
+    img->obdata = NULL;
+    img->data   = coom_alloc(NULL, size);
+    memcpy(img->data, src->data, size);
+    ASSERT_EXIT(XInitImage(img) != 0, 1, "Failed to initialize export image");
+    return img;
+}
+
+void coom_exporter_invalidate(coom_exporter *ex) {
+    if (ex->source == NULL) return;
+    pthread_mutex_lock(&ex->lock);
+    coom_export_release(ex->source);
+    pthread_mutex_unlock(&ex->lock);
+    ex->source = NULL;
+}
+
+void coom_exporter_submit(coom_exporter *ex, const XImage *img, bool live, const coom_export_request *req) {
+    if (!ex->started) {
+        coom_error("export: no worker thread, %s not saved", req->path);
+        return;
+    }
+    if (ex->source == NULL || ex->source->origin != img) {
+        coom_exporter_invalidate(ex);
+        // the copy is taken before the lock, the worker never waits on it
+        f64 start  = coom_time_now();
+        ex->source = coom_alloc(NULL, sizeof(coom_export_source));
+        *ex->source = (coom_export_source){.img = (XImage *)img, .origin = img, .owned = live, .refs = 1};
+        if (live) {
+            ex->source->img = coom_export_copy(img);
+            coom_info("export: copied the live capture in %.2f ms", (coom_time_now() - start) * 1000.0);
+        }
+    }
+    coom_export_job *job = coom_alloc(NULL, sizeof(coom_export_job));
+    *job                 = (coom_export_job){.req = *req, .source = ex->source};
+
+    pthread_mutex_lock(&ex->lock);
+    ex->source->refs += 1;
+    if (ex->tail) ex->tail->next = job;
+    else ex->head = job;
+    ex->tail = job;
+    ex->pending += 1;
+    coom_export_notify(ex);
+    pthread_cond_signal(&ex->wake);
+    pthread_mutex_unlock(&ex->lock);
+}
+
+int coom_exporter_update(coom_exporter *ex, Display *dpy) {
+    if (!ex->started) return -1;
+    char drain[64];
+    while (read(ex->pipe[0], drain, sizeof(drain)) > 0) {}
+
+    pthread_mutex_lock(&ex->lock);
+    bool  changed = ex->serial != ex->drawn;
+    usize pending = ex->pending;
+    f32   progress = ex->progress;
+    bool  last_ok  = ex->last_ok;
+    char  last[64];
+    memcpy(last, ex->last, sizeof(last));
+    ex->drawn = ex->serial;
+    pthread_mutex_unlock(&ex->lock);
+
+    f64 now = coom_time_now();
+    if (changed) {
+        if (ex->overlay.win == None) coom_overlay_create(&ex->overlay, dpy, ex->parent, COOM_OVERLAY_EXPORT, COOM_EXPORT_WIDEST);
+        if (!ex->shown) XMapRaised(dpy, ex->overlay.win);
+        ex->shown   = ex->redraw = true;
+        ex->hide_at = pending > 0 ? -1.0 : now + COOM_EXPORT_LINGER;
+    }
+    if (ex->shown && ex->hide_at >= 0.0 && now >= ex->hide_at) {
+        XUnmapWindow(dpy, ex->overlay.win);
+        ex->shown   = ex->redraw = false;
+        ex->hide_at = -1.0;
+    }
+    if (ex->redraw && ex->shown) {
+        ex->redraw = false;
+        char line[2][64] = {"", ""};
+        if (pending > 0) snprintf(line[0], sizeof(line[0]), "exporting %3.0f%%, %zu queued", progress * 100.0, pending - 1);
+        if (last[0]) snprintf(line[1], sizeof(line[1]), "%s %s", last_ok ? "saved" : "failed", last);
+        coom_overlay_draw(&ex->overlay, dpy, (const char *[]){line[0], line[1]});
+    }
+    return ex->hide_at < 0.0 ? -1 : (int)ceil((ex->hide_at - now) * 1000.0);
+}
+
+void coom_exporter_uninit(coom_exporter *ex, Display *dpy) {
+    if (ex->started) {
+        pthread_mutex_lock(&ex->lock);
+        if (ex->pending > 0) coom_info("export: finishing %zu queued exports", ex->pending);
+        ex->quit = true;
+        pthread_cond_signal(&ex->wake);
+        pthread_mutex_unlock(&ex->lock);
+        pthread_join(ex->thread, NULL);
+        coom_exporter_invalidate(ex);
+        pthread_cond_destroy(&ex->wake);
+        pthread_mutex_destroy(&ex->lock);
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (ex->pipe[i] > 0) close(ex->pipe[i]);
+    }
+    if (dpy) coom_overlay_destroy(&ex->overlay, dpy);
+    *ex = (coom_exporter){0};
+}
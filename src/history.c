@@ -0,0 +1,171 @@
+#include "coomer.h"
+
+// Every frame in the ring is the xor between two consecutive live captures, restricted to the
+// rectangle that changed. Xor is its own inverse, so the same delta steps the view backwards
+// and forwards, and the oldest frame can be dropped without touching the others.
+//
+// The xor is stored run-length encoded as pairs of u32 headers (zero pixels, literal pixels)
+// followed by the literal pixels, unchanged pixels are zero and collapse into the runs.
+
+#define COOM_HISTORY_MIN_RUN 3
+
+#define coom_history_at(h, i) (&(h)->frames[((h)->first + (i)) % COOM_HISTORY_MAX_FRAMES])
+#define coom_history_pixel(img, x, y) ((u32 *)((img)->data + (usize)(y) * (img)->bytes_per_line) + (x))
+
+bool coom_history_init(coom_history *h, XImage *img, usize budget) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    memset(h, 0, sizeof(coom_history));
+    if (img->bits_per_pixel != 32) {
+        coom_error("capture history needs a 32-bit visual, got %d bits per pixel", img->bits_per_pixel);
+        return false;
+    }
+    h->capacity = budget;
+    h->arena    = coom_alloc(NULL, budget);
+    coom_info("capture history: %zu bytes budget", budget);
+    return true;
+}
+
+void coom_history_uninit(coom_history *h) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    coom_free(h->arena);
+    coom_free(h->scratch);
+    coom_free(h->encoded);
+    if (h->view) {
+        coom_free(h->view->data);
+        coom_free(h->view);
+    }
+    memset(h, 0, sizeof(coom_history));
+}
+
+void coom_history_begin(coom_history *h, XImage *img, coom_rect rect) {
+    if (h->arena == NULL || rect.w <= 0 || rect.h <= 0) {
+        h->pending = (coom_rect){0};
+        return;
+    }
+    usize n = (usize)rect.w * rect.h;
+    if (n > h->scratch_cap) {
+        h->scratch     = coom_alloc(h->scratch, n * sizeof(u32));
+        h->encoded     = coom_alloc(h->encoded, (n * 2 + 2) * sizeof(u32));
+        h->scratch_cap = n;
+    }
+    for (int y = 0; y < rect.h; ++y) memcpy(&h->scratch[(usize)y * rect.w], coom_history_pixel(img, rect.x, rect.y + y), rect.w * sizeof(u32));
+    h->pending = rect;
+}
+
+static usize coom_history_encode(coom_history *h, coom_rect r) {
+    const u32 *delta = h->scratch;
+    u32       *out   = h->encoded;
+    usize      count = 0, n = (usize)r.w * r.h, i = 0;
+    while (i < n) {
+        u32 *header = &out[count];
+        count += 2;
+        usize zeros = 0, literals = 0;
+        while (i < n && delta[i] == 0) zeros += 1, i += 1;
+        while (i < n) {
+            // short zero runs are cheaper as literals than as a new header pair
+            usize run = 0;
+            while (i + run < n && run < COOM_HISTORY_MIN_RUN && delta[i + run] == 0) run += 1;
+            if (run >= COOM_HISTORY_MIN_RUN || i + run == n) break;
+            for (usize k = 0; k <= run; ++k) out[count++] = delta[i++];
+            literals += run + 1;
+        }
+        header[0] = zeros;
+        header[1] = literals;
+    }
+    return count * sizeof(u32);
+}
+
+static void coom_history_evict(coom_history *h) {
+    h->first = (h->first + 1) % COOM_HISTORY_MAX_FRAMES;
+    h->count -= 1;
+}
+
+void coom_history_commit(coom_history *h, XImage *img) {
+    coom_rect r = h->pending;
+    if (h->arena == NULL || r.w <= 0 || r.h <= 0) return;
+    h->pending = (coom_rect){0};
+
+    for (int y = 0; y < r.h; ++y) {
+        u32       *old = &h->scratch[(usize)y * r.w];
+        const u32 *now = coom_history_pixel(img, r.x, r.y + y);
+        for (int x = 0; x < r.w; ++x) old[x] ^= now[x];
+    }
+    usize size = coom_history_encode(h, r);
+    if (size > h->capacity) {
+        // the chain of deltas would have a hole, nothing older than this frame can be rebuilt
+        coom_warning("capture history: %zu byte frame does not fit the %zu byte budget, history dropped", size, h->capacity);
+        h->first = h->count = h->head = 0;
+        if (h->cursor > 0) h->resync = true;
+        h->cursor = 0;
+        return;
+    }
+
+    usize offset = h->head;
+    if (offset + size > h->capacity) offset = 0;
+    while (h->count > 0) {
+        coom_history_frame *oldest = coom_history_at(h, 0);
+        bool                overlap = oldest->offset < offset + size && offset < oldest->offset + oldest->size;
+        if (!overlap && h->count < COOM_HISTORY_MAX_FRAMES) break;
+        coom_history_evict(h);
+    }
+    memcpy(h->arena + offset, h->encoded, size);
+    h->head                       = offset + size;
+    *coom_history_at(h, h->count) = (coom_history_frame){.rect = r, .offset = offset, .size = size};
+    h->count += 1;
+
+    if (h->cursor > 0) {
+        // keep looking at the same moment while the live image moves on
+        h->cursor += 1;
+        if (h->cursor > h->count) {
+            coom_warning("capture history: scrubbed frame was evicted, back to live");
+            h->cursor = 0;
+            h->resync = true;
+        }
+    }
+}
+
+static void coom_history_apply(coom_history *h, coom_history_frame *f) {
+    const u32 *in  = (const u32 *)(h->arena + f->offset);
+    const u32 *end = (const u32 *)(h->arena + f->offset + f->size);
+    coom_rect  r   = f->rect;
+    int        x = 0, y = 0;
+    while (in < end) {
+        usize skip = in[0];
+        x += skip % r.w;
+        y += skip / r.w + x / r.w;
+        x %= r.w;
+        usize literals = in[1];
+        in += 2;
+        for (usize k = 0; k < literals; ++k) {
+            *coom_history_pixel(h->view, r.x + x, r.y + y) ^= *in++;
+            if (++x == r.w) x = 0, y += 1;
+        }
+    }
+}
+
+bool coom_history_step(coom_history *h, XImage *img, int direction, coom_rect *changed) {
+    if (h->arena == NULL) return false;
+    if (direction < 0 && h->cursor >= h->count) return false;
+    if (direction > 0 && h->cursor == 0) return false;
+
+    if (h->view == NULL) {
+        h->view         = coom_alloc(NULL, sizeof(XImage));
+        *h->view        = *img;
+        h->view->data   = coom_alloc(NULL, (usize)img->bytes_per_line * img->height);
+        h->view->obdata = NULL;
+    }
+    // the view only follows the live image while scrubbing, catch up when leaving live
+    if (h->cursor == 0) memcpy(h->view->data, img->data, (usize)img->bytes_per_line * img->height);
+
+    if (direction < 0) {
+        coom_history_apply(h, coom_history_at(h, h->count - 1 - h->cursor));
+        *changed = coom_history_at(h, h->count - 1 - h->cursor)->rect;
+        h->cursor += 1;
+    } else {
+        h->cursor -= 1;
+        coom_history_apply(h, coom_history_at(h, h->count - 1 - h->cursor));
+        *changed = coom_history_at(h, h->count - 1 - h->cursor)->rect;
+    }
+    coom_info("capture history: %zu/%zu frames back", h->cursor, h->count);
+    return true;
+}
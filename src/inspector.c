@@ -0,0 +1,60 @@
+#include "coomer.h"
+
+// widest line the overlay ever shows, sizes the window once
+#define COOM_INSPECTOR_WIDEST "99x99 avg    #ffffff  255 255 255"
+
+void coom_inspector_toggle(coom_inspector *in, Display *dpy, Window parent, int size) {
+    if (in->overlay.win == None) coom_overlay_create(&in->overlay, dpy, parent, COOM_OVERLAY_INSPECTOR, COOM_INSPECTOR_WIDEST);
+    in->enabled = !in->enabled;
+    in->size    = size < 1 ? 1 : size | 1;
+    if (in->enabled) XMapRaised(dpy, in->overlay.win);
+    else XUnmapWindow(dpy, in->overlay.win);
+    in->stale = in->enabled;
+}
+
+static void coom_inspector_draw(coom_inspector *in, Display *dpy) {
+    char line[2][64] = {"outside the capture", ""};
+    if (in->inside) {
+        u32 p = in->rgb, a = in->average;
+        snprintf(line[0], sizeof(line[0]), "%5d,%-5d    #%06x  %3u %3u %3u", in->x, in->y, p, p >> 16, (p >> 8) & 0xff, p & 0xff);
+        snprintf(line[1], sizeof(line[1]), "%2dx%-2d avg    #%06x  %3u %3u %3u", in->size, in->size, a, a >> 16, (a >> 8) & 0xff, a & 0xff);
+    }
+    coom_overlay_draw(&in->overlay, dpy, (const char *[]){line[0], line[1]});
+}
+
+void coom_inspector_update(coom_inspector *in, Display *dpy, const XImage *img, int x, int y) {
+    in->stale  = false;
+    in->inside = x >= 0 && y >= 0 && x < img->width && y < img->height;
+    in->x      = x;
+    in->y      = y;
+    if (in->inside) {
+        in->rgb = coom_decode_pixel(img, XGetPixel((XImage *)img, x, y));
+
+        // the square is clipped to the capture, the average only counts what is inside
+        int x0 = x - in->size / 2, y0 = y - in->size / 2, x1 = x0 + in->size, y1 = y0 + in->size;
+        x0 = x0 < 0 ? 0 : x0;
+        y0 = y0 < 0 ? 0 : y0;
+        x1 = x1 > img->width ? img->width : x1;
+        y1 = y1 > img->height ? img->height : y1;
+        u32 sum[3] = {0}, count = (x1 - x0) * (y1 - y0);
+        for (int sy = y0; sy < y1; ++sy) {
+            for (int sx = x0; sx < x1; ++sx) {
+                u32 p = coom_decode_pixel(img, XGetPixel((XImage *)img, sx, sy));
+                sum[0] += p >> 16, sum[1] += (p >> 8) & 0xff, sum[2] += p & 0xff;
+            }
+        }
+        in->average = (sum[0] + count / 2) / count << 16 | (sum[1] + count / 2) / count << 8 | (sum[2] + count / 2) / count;
+    }
+    coom_inspector_draw(in, dpy);
+}
+
+const char *coom_inspector_hex(const coom_inspector *in, bool average) {
+    static char hex[8];
+    snprintf(hex, sizeof(hex), "#%06x", average ? in->average : in->rgb);
+    return hex;
+}
+
+void coom_inspector_uninit(coom_inspector *in, Display *dpy) {
+    coom_overlay_destroy(&in->overlay, dpy);
+    *in = (coom_inspector){0};
+}
@@ -7,6 +7,7 @@ int main(int argc, char *argv[]) {
 
     if (!parse_args(&argc, &argv, &args)) return 1;
     if (args.new_config != NULL) return !coom_generate_default_config(args.new_config);
+    if (args.bench != NULL) return !coom_run_bench(args.bench);
     if (args.delay_second) mssleep(args.delay_second * 1000);
 
     coom_t coom = coom_init_coom(args);
@@ -0,0 +1,50 @@
+#include "coomer.h"
+
+// The overlays are plain core X child windows drawn with XDrawImageString, they work the same
+// under both renderers and never touch the GL pipeline.
+
+#define COOM_OVERLAY_PAD  6
+#define COOM_OVERLAY_FONT "fixed"
+
+void coom_overlay_create(coom_overlay *ov, Display *dpy, Window parent, int slot, const char *widest) {
+    int                  screen = DefaultScreen(dpy);
+    XSetWindowAttributes swa    = {0};
+    // the zoom window may have a GLX visual, the overlay sticks to the default one
+    swa.colormap         = DefaultColormap(dpy, screen);
+    swa.background_pixel = BlackPixel(dpy, screen);
+    swa.border_pixel     = WhitePixel(dpy, screen);
+    swa.event_mask       = ExposureMask;
+
+    ov->font = XLoadQueryFont(dpy, COOM_OVERLAY_FONT);
+    if (ov->font == NULL) coom_warning("no '%s' font, the overlay uses the server default", COOM_OVERLAY_FONT);
+    ov->ascent  = ov->font ? ov->font->ascent : 10;
+    ov->descent = ov->font ? ov->font->descent : 3;
+    ov->columns = strlen(widest);
+    int width   = ov->font ? XTextWidth(ov->font, widest, ov->columns) : 6 * ov->columns;
+    int height  = COOM_OVERLAY_LINES * (ov->ascent + ov->descent) + 2 * COOM_OVERLAY_PAD;
+
+    // every slot has the same height, they stack down from the top left corner with a border of 1
+    ov->win = XCreateWindow(dpy, parent, COOM_OVERLAY_PAD, COOM_OVERLAY_PAD + slot * (height + 2 + COOM_OVERLAY_PAD), width + 2 * COOM_OVERLAY_PAD, height,
+                            1, DefaultDepth(dpy, screen), InputOutput, DefaultVisual(dpy, screen), CWColormap | CWBackPixel | CWBorderPixel | CWEventMask,
+                            &swa);
+    ov->gc  = XCreateGC(dpy, ov->win, 0, NULL);
+    XSetForeground(dpy, ov->gc, WhitePixel(dpy, screen));
+    XSetBackground(dpy, ov->gc, BlackPixel(dpy, screen));
+    if (ov->font) XSetFont(dpy, ov->gc, ov->font->fid);
+}
+
+void coom_overlay_draw(coom_overlay *ov, Display *dpy, const char *lines[COOM_OVERLAY_LINES]) {
+    char line[128];
+    for (int i = 0; i < COOM_OVERLAY_LINES; ++i) {
+        // padded to the widest line, image strings paint their own background, no clear and no flicker
+        snprintf(line, sizeof(line), "%-*s", ov->columns, lines[i] ? lines[i] : "");
+        XDrawImageString(dpy, ov->win, ov->gc, COOM_OVERLAY_PAD, COOM_OVERLAY_PAD + ov->ascent + i * (ov->ascent + ov->descent), line, strlen(line));
+    }
+}
+
+void coom_overlay_destroy(coom_overlay *ov, Display *dpy) {
+    if (ov->font) XFreeFont(dpy, ov->font);
+    if (ov->gc) XFreeGC(dpy, ov->gc);
+    if (ov->win != None) XDestroyWindow(dpy, ov->win);
+    *ov = (coom_overlay){0};
+}
@@ -0,0 +1,266 @@
+#include <zlib.h>
+
+#include "coomer.h"
+
+// The image data is one zlib stream cut in chunks of rows that are filtered and deflated on
+// their own, pigz style. Every chunk but the last ends with a sync flush so the raw deflate
+// pieces concatenate into a valid stream, and starts with the last 32K of the rows before it
+// as a dictionary so the cut costs almost nothing in size. The adler32 of the whole stream is
+// combined from the per chunk ones. Each chunk becomes one IDAT.
+
+#define COOM_PNG_CHUNK_BYTES (256 * 1024)
+#define COOM_PNG_WINDOW      (32 * 1024)
+// chunks per batch and thread, like the bands of coom_parallel_for
+#define COOM_PNG_BATCH       4
+
+enum { COOM_PNG_HEADER, COOM_PNG_DATA, COOM_PNG_END, COOM_PNG_DONE };
+enum { COOM_PNG_NONE, COOM_PNG_SUB, COOM_PNG_UP, COOM_PNG_AVERAGE, COOM_PNG_PAETH };
+
+struct coom_png_slot {
+    z_stream zs;
+    bool     ready;  // zs was initialized
+    u8      *rgb;    // dictionary rows, chunk rows and the row before them, converted
+    u8      *raw;    // the same rows filtered, what goes through deflate
+    u8      *out;
+    usize    out_cap, out_size;
+    usize    chunk;
+    usize    raw_size;  // of the chunk rows alone
+    u32      adler;
+    bool     failed;
+};
+
+static inline u8 coom_png_paeth(u8 a, u8 b, u8 c) {
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// minimum sum of absolute differences picks the filter of every row, the libpng heuristic. the
+// choice only depends on the row and the one above, so a chunk filters its dictionary rows the
+// same way the chunk before did
+static void coom_png_filter_row(const u8 *row, const u8 *prev, usize n, u8 *out, int level) {
+    int filter = COOM_PNG_NONE;
+    if (level > 0) {
+        u64 sum[5] = {0};
+        for (usize i = 0; i < n; ++i) {
+            u8 a = i >= 3 ? row[i - 3] : 0, b = prev[i], c = i >= 3 ? prev[i - 3] : 0, x = row[i];
+            sum[COOM_PNG_NONE] += abs((s8)x);
+            sum[COOM_PNG_SUB] += abs((s8)(u8)(x - a));
+            sum[COOM_PNG_UP] += abs((s8)(u8)(x - b));
+            sum[COOM_PNG_PAETH] += abs((s8)(u8)(x - coom_png_paeth(a, b, c)));
+        }
+        sum[COOM_PNG_AVERAGE] = UINT64_MAX;
+        for (int f = COOM_PNG_SUB; f <= COOM_PNG_PAETH; ++f) {
+            if (sum[f] < sum[filter]) filter = f;
+        }
+    }
+    out[0] = filter;
+    out += 1;
+    switch (filter) {
+        case COOM_PNG_NONE: memcpy(out, row, n); break;
+        case COOM_PNG_SUB:
+            for (usize i = 0; i < n; ++i) out[i] = row[i] - (i >= 3 ? row[i - 3] : 0);
+            break;
+        case COOM_PNG_UP:
+            for (usize i = 0; i < n; ++i) out[i] = row[i] - prev[i];
+            break;
+        default:
+            for (usize i = 0; i < n; ++i) out[i] = row[i] - coom_png_paeth(i >= 3 ? row[i - 3] : 0, prev[i], i >= 3 ? prev[i - 3] : 0);
+            break;
+    }
+}
+
+static void coom_png_deflate_chunk(coom_png *png, coom_png_slot *slot) {
+    const XImage *img   = png->img;
+    usize         n     = (usize)img->width * 3;
+    int           y0    = slot->chunk * png->chunk_rows;
+    int           y1    = y0 + png->chunk_rows < img->height ? y0 + png->chunk_rows : img->height;
+    int           first = y0 - png->dict_rows > 0 ? y0 - png->dict_rows : 0;
+    bool          last  = slot->chunk + 1 == png->chunks;
+
+    // row `first - 1` only serves as the one above `first`
+    u8 *rgb = slot->rgb;
+    memset(rgb, 0, n);
+    if (first > 0) png->row(img, first - 1, rgb);
+    for (int y = first; y < y1; ++y) {
+        u8 *curr = rgb + (usize)(y - first + 1) * n;
+        png->row(img, y, curr);
+        coom_png_filter_row(curr, curr - n, n, slot->raw + (usize)(y - first) * png->stride, png->level);
+    }
+    usize dict = (usize)(y0 - first) * png->stride;
+    u8   *data = slot->raw + dict;
+    slot->raw_size = (usize)(y1 - y0) * png->stride;
+    slot->adler    = adler32(adler32(0, NULL, 0), data, slot->raw_size);
+
+    z_stream *zs = &slot->zs;
+    slot->failed = deflateReset(zs) != Z_OK;
+    if (!slot->failed && dict > 0) {
+        usize window = dict < COOM_PNG_WINDOW ? dict : COOM_PNG_WINDOW;
+        slot->failed = deflateSetDictionary(zs, data - window, window) != Z_OK;
+    }
+    zs->next_in   = data;
+    zs->avail_in  = slot->raw_size;
+    zs->next_out  = slot->out;
+    zs->avail_out = slot->out_cap;
+    int status    = slot->failed ? Z_STREAM_ERROR : deflate(zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+    // the buffer is sized with deflateBound, everything fits in one call
+    slot->failed   = last ? status != Z_STREAM_END : status != Z_OK || zs->avail_in != 0;
+    slot->out_size = slot->out_cap - zs->avail_out;
+}
+
+static void coom_png_deflate_chunks(void *ctx, usize begin, usize end) {
+    coom_png *png = ctx;
+    for (usize i = begin; i < end; ++i) coom_png_deflate_chunk(png, &png->slots[i]);
+}
+
+static void coom_png_put32(u8 *p, u32 v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static u8 *coom_png_reserve(coom_png *png, usize size) {
+    if (png->out_size + size > png->out_cap) {
+        png->out_cap = (png->out_size + size) * 2;
+        png->out     = coom_alloc(png->out, png->out_cap);
+    }
+    u8 *p = png->out + png->out_size;
+    png->out_size += size;
+    return p;
+}
+
+// length, type, data and the crc over type and data
+static void coom_png_chunk(coom_png *png, const char *type, const u8 *prefix, usize prefix_size, const u8 *data, usize size, const u8 *suffix,
+                           usize suffix_size) {
+    usize length = prefix_size + size + suffix_size;
+    u8   *p      = coom_png_reserve(png, 12 + length);
+    coom_png_put32(p, length);
+    memcpy(p + 4, type, 4);
+    if (prefix_size) memcpy(p + 8, prefix, prefix_size);
+    if (size) memcpy(p + 8 + prefix_size, data, size);
+    if (suffix_size) memcpy(p + 8 + prefix_size + size, suffix, suffix_size);
+    coom_png_put32(p + 8 + length, crc32(crc32(0, NULL, 0), p + 4, 4 + length));
+}
+
+bool coom_png_begin(coom_png *png, const XImage *img, int level) {
+    *png = (coom_png){
+        .img    = img,
+        .row    = coom_rgb_row_converter(img, COOM_CONVERT_COUNT - 1, NULL),
+        .level  = level < 0 ? 0 : level > 9 ? 9 : level,
+        .stride = (usize)img->width * 3 + 1,
+        .adler  = adler32(0, NULL, 0),
+    };
+    png->chunk_rows = COOM_PNG_CHUNK_BYTES / png->stride > 0 ? COOM_PNG_CHUNK_BYTES / png->stride : 1;
+    png->dict_rows  = (COOM_PNG_WINDOW + png->stride - 1) / png->stride;
+    png->chunks     = (img->height + png->chunk_rows - 1) / png->chunk_rows;
+
+    usize threads   = coom_parallel_threads();
+    png->slot_count = threads * COOM_PNG_BATCH < png->chunks ? threads * COOM_PNG_BATCH : png->chunks;
+    png->slots      = coom_alloc(NULL, png->slot_count * sizeof(coom_png_slot));
+    memset(png->slots, 0, png->slot_count * sizeof(coom_png_slot));
+    usize rows = png->chunk_rows + png->dict_rows;
+    for (usize i = 0; i < png->slot_count; ++i) {
+        coom_png_slot *slot = &png->slots[i];
+        // png data is already decorrelated by the row filters, Z_FILTERED favors the matches
+        if (deflateInit2(&slot->zs, png->level, Z_DEFLATED, -15, 8, Z_FILTERED) != Z_OK) {
+            coom_error("png: deflateInit2 failed");
+            coom_png_end(png);
+            return false;
+        }
+        slot->ready   = true;
+        slot->rgb     = coom_alloc(NULL, (rows + 1) * (png->stride - 1));
+        slot->raw     = coom_alloc(NULL, rows * png->stride);
+        // a sync flush adds an empty stored block to the bound of a finished stream
+        slot->out_cap = deflateBound(&slot->zs, png->chunk_rows * png->stride) + 16;
+        slot->out     = coom_alloc(NULL, slot->out_cap);
+    }
+    coom_info("png: %dx%d level %d, %zu chunks of %d rows, %zu at a time", img->width, img->height, png->level, png->chunks, png->chunk_rows, png->slot_count);
+    return true;
+}
+
+bool coom_png_next(coom_png *png, const u8 **data, usize *size) {
+    png->out_size = 0;
+    switch (png->stage) {
+        case COOM_PNG_HEADER: {
+            static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+            memcpy(coom_png_reserve(png, sizeof(signature)), signature, sizeof(signature));
+            // 8-bit truecolor, deflate, adaptive filters, no interlace
+            u8 ihdr[13] = {0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0};
+            coom_png_put32(ihdr, png->img->width);
+            coom_png_put32(ihdr + 4, png->img->height);
+            coom_png_chunk(png, "IHDR", NULL, 0, ihdr, sizeof(ihdr), NULL, 0);
+            png->stage = png->chunks > 0 ? COOM_PNG_DATA : COOM_PNG_END;
+        } break;
+        case COOM_PNG_DATA: {
+            usize count = png->chunks - png->next < png->slot_count ? png->chunks - png->next : png->slot_count;
+            for (usize i = 0; i < count; ++i) png->slots[i].chunk = png->next + i;
+            coom_parallel_for(count, coom_png_deflate_chunks, png);
+            for (usize i = 0; i < count; ++i) {
+                coom_png_slot *slot = &png->slots[i];
+                if (slot->failed) {
+                    coom_error("png: deflate failed on chunk %zu", slot->chunk);
+                    png->stage  = COOM_PNG_DONE;
+                    png->failed = true;
+                    return false;
+                }
+                png->adler = adler32_combine(png->adler, slot->adler, slot->raw_size);
+                // the zlib header opens the first IDAT and the adler32 closes the last one
+                u8 header[2] = {0x78, png->level < 2 ? 0x01 : png->level < 6 ? 0x5e : png->level == 6 ? 0x9c : 0xda}, trailer[4];
+                coom_png_put32(trailer, png->adler);
+                bool first = slot->chunk == 0, last = slot->chunk + 1 == png->chunks;
+                coom_png_chunk(png, "IDAT", header, first ? 2 : 0, slot->out, slot->out_size, trailer, last ? 4 : 0);
+            }
+            png->next += count;
+            if (png->next == png->chunks) png->stage = COOM_PNG_END;
+        } break;
+        case COOM_PNG_END:
+            coom_png_chunk(png, "IEND", NULL, 0, NULL, 0, NULL, 0);
+            png->stage = COOM_PNG_DONE;
+            break;
+        default: return false;
+    }
+    *data = png->out;
+    *size = png->out_size;
+    return true;
+}
+
+void coom_png_end(coom_png *png) {
+    for (usize i = 0; i < png->slot_count; ++i) {
+        coom_png_slot *slot = &png->slots[i];
+        if (slot->ready) deflateEnd(&slot->zs);
+        coom_free(slot->rgb);
+        coom_free(slot->raw);
+        coom_free(slot->out);
+    }
+    coom_free(png->slots);
+    coom_free(png->out);
+    *png = (coom_png){0};
+}
+
+bool coom_save_to_png(const XImage *img, const char *file_path, int level, coom_progress_fn progress, void *ctx) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    if (img == NULL) return false;
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) {
+        coom_error("failed to open file: '%s' - %s", file_path, strerror(errno));
+        return false;
+    }
+    coom_png  png;
+    bool      result = coom_png_begin(&png, img, level);
+    const u8 *data;
+    usize     size;
+    while (result && coom_png_next(&png, &data, &size)) {
+        if (fwrite(data, 1, size, f) != size) {
+            coom_error("failed to write '%s' - %s", file_path, strerror(errno));
+            result = false;
+        }
+        if (progress && png.chunks > 0) progress(ctx, (f32)png.next / png.chunks);
+    }
+    result = result && !png.failed;
+    coom_png_end(&png);
+    if (fclose(f) != 0 && result) {
+        coom_error("failed to write '%s' - %s", file_path, strerror(errno));
+        result = false;
+    }
+    return result;
+}
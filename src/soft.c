@@ -0,0 +1,219 @@
+#include "coomer.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// same as the glClearColor of the GL path
+#define COOM_SOFT_BACKGROUND 0x1a1a1a
+// bilinear weights in 7 bits, (b - a) * w stays inside a signed 16-bit lane
+#define COOM_SOFT_FRAC_BITS 7
+#define COOM_SOFT_FRAC_ONE  (1 << COOM_SOFT_FRAC_BITS)
+
+#define coom_soft_row(img, y) ((u32 *)((img)->data + (usize)(y) * (img)->bytes_per_line))
+
+typedef struct {
+    XImage       *dst;
+    const XImage *src;
+    f32           x0, y0;  // capture position of the window origin
+    f32           step;    // capture pixels per window pixel
+    bool          bilinear;
+    const s32    *xs;  // source column per window column, -1 outside the capture
+    const u8     *fx;  // bilinear weight of the column right of `xs`
+    // flashlight
+    bool          shadow;
+    f32           cursor_x, cursor_y, radius;
+    u16           keep;  // 16-bit fixed point of 1 - shadow
+} coom_soft_job;
+
+static void coom_soft_fill(u32 *row, usize n, u32 color) {
+    for (usize i = 0; i < n; ++i) row[i] = color;
+}
+
+// scale every channel of `n` pixels by keep / 65536
+static void coom_soft_darken(u32 *row, usize n, u16 keep) {
+    usize i = 0;
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128(), k = _mm_set1_epi16((short)keep);
+    for (; i + 4 <= n; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)&row[i]);
+        __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(px, zero), k);
+        __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(px, zero), k);
+        _mm_storeu_si128((__m128i *)&row[i], _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < n; ++i) {
+        u32 p = row[i], r = 0;
+        for (int c = 0; c < 32; c += 8) r |= ((((p >> c) & 0xff) * keep) >> 16) << c;
+        row[i] = r;
+    }
+}
+
+static inline u32 coom_soft_lerp(const u32 *top, const u32 *bottom, u32 fx, u32 fy) {
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i t    = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)top), zero);
+    __m128i b    = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)bottom), zero);
+    // vertical first on both columns at once, then left against right
+    __m128i v    = _mm_add_epi16(t, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, t), _mm_set1_epi16(fy)), COOM_SOFT_FRAC_BITS));
+    __m128i r    = _mm_srli_si128(v, 8);
+    __m128i h    = _mm_add_epi16(v, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(r, v), _mm_set1_epi16(fx)), COOM_SOFT_FRAC_BITS));
+    return (u32)_mm_cvtsi128_si32(_mm_packus_epi16(h, h));
+#else
+    u32 result = 0;
+    for (int c = 0; c < 32; c += 8) {
+        s32 tl = (top[0] >> c) & 0xff, tr = (top[1] >> c) & 0xff;
+        s32 bl = (bottom[0] >> c) & 0xff, br = (bottom[1] >> c) & 0xff;
+        s32 l = tl + (((bl - tl) * (s32)fy) >> COOM_SOFT_FRAC_BITS);
+        s32 r = tr + (((br - tr) * (s32)fy) >> COOM_SOFT_FRAC_BITS);
+        result |= (u32)(l + (((r - l) * (s32)fx) >> COOM_SOFT_FRAC_BITS)) << c;
+    }
+    return result;
+#endif
+}
+
+static void coom_soft_draw_rows(void *ctx, usize begin, usize end) {
+    const coom_soft_job *job = ctx;
+    const XImage        *src = job->src;
+    usize                width = job->dst->width;
+    for (usize y = begin; y < end; ++y) {
+        u32 *out = coom_soft_row(job->dst, y);
+        f32  v   = job->y0 + (y + 0.5) * job->step;
+        if (v < 0.0 || v >= src->height) {
+            coom_soft_fill(out, width, COOM_SOFT_BACKGROUND);
+        } else if (!job->bilinear) {
+            const u32 *in = coom_soft_row(src, (int)v);
+            for (usize x = 0; x < width; ++x) out[x] = job->xs[x] < 0 ? COOM_SOFT_BACKGROUND : in[job->xs[x]];
+        } else {
+            // texel centers sit on .5, the last row and column are clamped
+            f32 sv = v - 0.5;
+            int sy = floorf(sv);
+            u32 fy = (sv - sy) * COOM_SOFT_FRAC_ONE;
+            if (sy < 0) sy = 0, fy = 0;
+            if (sy > src->height - 2) sy = src->height - 2, fy = COOM_SOFT_FRAC_ONE;
+            const u32 *top = coom_soft_row(src, sy), *bottom = coom_soft_row(src, sy + 1);
+            for (usize x = 0; x < width; ++x) {
+                s32 sx = job->xs[x];
+                out[x] = sx < 0 ? COOM_SOFT_BACKGROUND : coom_soft_lerp(&top[sx], &bottom[sx], job->fx[x], fy);
+            }
+        }
+        if (!job->shadow) continue;
+
+        // everything outside the circle is darkened, the inside of a row is a single span
+        f32   dy = (y + 0.5) - job->cursor_y;
+        usize x0 = width, x1 = width;
+        if (dy * dy < job->radius * job->radius) {
+            f32 half = sqrtf(job->radius * job->radius - dy * dy);
+            f32 a = ceilf(job->cursor_x - half - 0.5), b = ceilf(job->cursor_x + half - 0.5);
+            x0 = a < 0.0 ? 0 : a > width ? width : a;
+            x1 = b < 0.0 ? 0 : b > width ? width : b;
+        }
+        coom_soft_darken(out, x0, job->keep);
+        coom_soft_darken(out + x1, width - x1, job->keep);
+    }
+}
+
+void coom_soft_draw(XImage *dst, const XImage *src, const coom_camera *cam, vec2_t cursor, const coom_flashlight *fl) {
+    coom_soft_job job = {
+        .dst      = dst,
+        .src      = src,
+        .step     = 1.0 / cam->scale,
+        // magnified pixels stay sharp, like the GL_NEAREST magnification filter
+        .bilinear = cam->scale < 1.0 && src->width > 1 && src->height > 1,
+        .shadow   = fl->shadow > 0.0,
+        .cursor_x = cursor.x,
+        .cursor_y = cursor.y,
+        .radius   = fl->radius * cam->scale,
+        .keep     = fminf(1.0 - fl->shadow, 1.0) * 65535.0,
+    };
+    // inverse of the vertex shader, see coom_camera_visible
+    job.x0 = cam->position.x + (src->width - dst->width * job.step) * 0.5;
+    job.y0 = cam->position.y + (src->height - dst->height * job.step) * 0.5;
+
+    // every row maps its columns the same way, work them out once per frame
+    s32 *xs = coom_alloc(NULL, dst->width * sizeof(s32));
+    u8  *fx = coom_alloc(NULL, dst->width);
+    for (int x = 0; x < dst->width; ++x) {
+        f32 u = job.x0 + (x + 0.5) * job.step;
+        xs[x] = u < 0.0 || u >= src->width ? -1 : (s32)u;
+        fx[x] = 0;
+        if (!job.bilinear || xs[x] < 0) continue;
+        f32 su = u - 0.5;
+        s32 sx = floorf(su);
+        fx[x]  = (su - sx) * COOM_SOFT_FRAC_ONE;
+        if (sx < 0) sx = 0, fx[x] = 0;
+        if (sx > src->width - 2) sx = src->width - 2, fx[x] = COOM_SOFT_FRAC_ONE;
+        xs[x] = sx;
+    }
+    job.xs = xs;
+    job.fx = fx;
+    coom_parallel_for(dst->height, coom_soft_draw_rows, &job);
+    coom_free(xs);
+    coom_free(fx);
+}
+
+void coom_soft_init(coom_soft *soft, Display *dpy, Window win) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    *soft = (coom_soft){.visual = DefaultVisual(dpy, DefaultScreen(dpy)), .depth = DefaultDepth(dpy, DefaultScreen(dpy))};
+    if (XShmQueryExtension(dpy)) soft->completion = XShmGetEventBase(dpy) + ShmCompletion;
+    soft->gc = XCreateGC(dpy, win, 0, NULL);
+    coom_info("software renderer on %zu threads, %s presentation", coom_parallel_threads(), soft->completion ? "XShmPutImage" : "XPutImage");
+}
+
+static void coom_soft_delete_back(coom_soft *soft, Display *dpy) {
+    if (soft->back == NULL) return;
+    coom_soft_wait(soft, dpy);
+    coom_delete_screenshot(dpy, soft->back);
+    soft->back = NULL;
+}
+
+bool coom_soft_resize(coom_soft *soft, Display *dpy, int width, int height) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    coom_soft_delete_back(soft, dpy);
+    if (soft->completion) soft->back = coom_new_shm_image(dpy, soft->visual, soft->depth, width, height);
+    if (soft->back == NULL) {
+        // no MIT-SHM, e.g. remote display, every frame goes through the socket
+        soft->completion = 0;
+        soft->back       = XCreateImage(dpy, soft->visual, soft->depth, ZPixmap, 0, NULL, width, height, 32, 0);
+        if (soft->back == NULL) return false;
+        soft->back->data = coom_alloc(NULL, (usize)soft->back->bytes_per_line * height);
+    }
+    if (soft->back->bits_per_pixel != 32) {
+        coom_error("software renderer needs a 32-bit visual, got %d bits per pixel", soft->back->bits_per_pixel);
+        coom_soft_delete_back(soft, dpy);
+        return false;
+    }
+    return true;
+}
+
+static Bool coom_soft_is_completion(Display *dpy, XEvent *ev, XPointer arg) {
+    (void)dpy;
+    return ev->type == ((coom_soft *)arg)->completion;
+}
+
+void coom_soft_wait(coom_soft *soft, Display *dpy) {
+    if (!soft->busy) return;
+    XEvent ev;
+    XIfEvent(dpy, &ev, coom_soft_is_completion, (XPointer)soft);
+    soft->busy = false;
+}
+
+void coom_soft_present(coom_soft *soft, Display *dpy, Window win) {
+    if (soft->back == NULL) return;
+    if (soft->completion) {
+        // the server reads the segment after we return, the next draw waits for ShmCompletion
+        XShmPutImage(dpy, win, soft->gc, soft->back, 0, 0, 0, 0, soft->back->width, soft->back->height, True);
+        soft->busy = true;
+    } else {
+        XPutImage(dpy, win, soft->gc, soft->back, 0, 0, 0, 0, soft->back->width, soft->back->height);
+    }
+    XFlush(dpy);
+}
+
+void coom_soft_uninit(coom_soft *soft, Display *dpy) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    coom_soft_delete_back(soft, dpy);
+    if (soft->gc) XFreeGC(dpy, soft->gc);
+    coom_parallel_uninit();
+    *soft = (coom_soft){0};
+}
@@ -2,7 +2,10 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <sys/resource.h>
 #include <time.h>
+#include <unistd.h>
 
 bool verbose = false;
 
@@ -152,3 +155,151 @@ void mssleep(u32 ms) {
     ts.tv_nsec = (ms % 1000) * 1000000;
     nanosleep(&ts, NULL);
 }
+
+f64 coom_time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
+
+void coom_sleep_until(f64 deadline) {
+    struct timespec ts;
+    ts.tv_sec  = (time_t)deadline;
+    ts.tv_nsec = (long)((deadline - (f64)ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+bool coom_has_extension(const char *list, const char *name) {
+    usize len = strlen(name);
+    for (const char *p = list; p != NULL && (p = strstr(p, name)) != NULL; p += len)
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) return true;
+    return false;
+}
+
+f64 coom_cpu_time(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (f64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + (f64)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+// a few bands per thread so an uneven band does not leave the others idle
+#define COOM_PARALLEL_BANDS_PER_THREAD 4
+
+// callers that can run at the same time, e.g. the render loop and a background export
+#define COOM_PARALLEL_JOBS 4
+
+typedef struct {
+    coom_parallel_fn fn;
+    void            *ctx;
+    usize            total, bands, next, finished;
+    bool             used;
+} coom_parallel_job;
+
+static struct {
+    pthread_mutex_t   lock;
+    pthread_cond_t    wake, done;
+    pthread_t        *threads;
+    usize             count;  // workers, every caller of coom_parallel_for is one more
+    bool              started, quit;
+    coom_parallel_job jobs[COOM_PARALLEL_JOBS];
+} g_pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+
+// called and returns with the lock held
+static void coom_parallel_run_band(coom_parallel_job *job) {
+    usize band  = job->next++;
+    usize begin = job->total * band / job->bands, end = job->total * (band + 1) / job->bands;
+    pthread_mutex_unlock(&g_pool.lock);
+    if (begin < end) job->fn(job->ctx, begin, end);
+    pthread_mutex_lock(&g_pool.lock);
+    // callers wait on their own job, every one of them has to look
+    if (++job->finished == job->bands) pthread_cond_broadcast(&g_pool.done);
+}
+
+// a job with bands nobody took yet, the oldest slot first
+static coom_parallel_job *coom_parallel_pending(void) {
+    for (usize i = 0; i < COOM_PARALLEL_JOBS; ++i) {
+        if (g_pool.jobs[i].used && g_pool.jobs[i].next < g_pool.jobs[i].bands) return &g_pool.jobs[i];
+    }
+    return NULL;
+}
+
+static void *coom_parallel_worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_pool.lock);
+    for (;;) {
+        coom_parallel_job *job;
+        while (!g_pool.quit && (job = coom_parallel_pending()) == NULL) pthread_cond_wait(&g_pool.wake, &g_pool.lock);
+        if (g_pool.quit) break;
+        coom_parallel_run_band(job);
+    }
+    pthread_mutex_unlock(&g_pool.lock);
+    return NULL;
+}
+
+static void coom_parallel_start(void) {
+    long cores      = sysconf(_SC_NPROCESSORS_ONLN);
+    g_pool.started  = true;
+    g_pool.count    = cores > 1 ? cores - 1 : 0;
+    g_pool.threads  = coom_alloc(NULL, (g_pool.count + 1) * sizeof(pthread_t));
+    for (usize i = 0; i < g_pool.count; ++i) {
+        if (pthread_create(&g_pool.threads[i], NULL, coom_parallel_worker, NULL) != 0) {
+            coom_warning("thread pool: only %zu of %zu workers started", i, g_pool.count);
+            g_pool.count = i;
+            break;
+        }
+    }
+    coom_info("thread pool: %zu workers", g_pool.count);
+}
+
+void coom_parallel_for(usize count, coom_parallel_fn fn, void *ctx) {
+    if (count == 0) return;
+    pthread_mutex_lock(&g_pool.lock);
+    if (!g_pool.started) coom_parallel_start();
+    coom_parallel_job *job = NULL;
+    for (usize i = 0; i < COOM_PARALLEL_JOBS && job == NULL; ++i) {
+        if (!g_pool.jobs[i].used) job = &g_pool.jobs[i];
+    }
+    if (job == NULL) {
+        // more concurrent callers than slots, this one does without the pool
+        pthread_mutex_unlock(&g_pool.lock);
+        fn(ctx, 0, count);
+        return;
+    }
+    *job = (coom_parallel_job){
+        .fn    = fn,
+        .ctx   = ctx,
+        .total = count,
+        .bands = (g_pool.count + 1) * COOM_PARALLEL_BANDS_PER_THREAD,
+        .used  = true,
+    };
+    pthread_cond_broadcast(&g_pool.wake);
+    // the caller only helps with its own job, it returns as soon as that one is done
+    while (job->next < job->bands) coom_parallel_run_band(job);
+    while (job->finished < job->bands) pthread_cond_wait(&g_pool.done, &g_pool.lock);
+    job->used = false;
+    pthread_mutex_unlock(&g_pool.lock);
+}
+
+usize coom_parallel_threads(void) {
+    pthread_mutex_lock(&g_pool.lock);
+    if (!g_pool.started) coom_parallel_start();
+    usize threads = g_pool.count + 1;
+    pthread_mutex_unlock(&g_pool.lock);
+    return threads;
+}
+
+void coom_parallel_uninit(void) {
+    pthread_mutex_lock(&g_pool.lock);
+    if (!g_pool.started) {
+        pthread_mutex_unlock(&g_pool.lock);
+        return;
+    }
+    g_pool.quit = true;
+    pthread_cond_broadcast(&g_pool.wake);
+    pthread_mutex_unlock(&g_pool.lock);
+    for (usize i = 0; i < g_pool.count; ++i) pthread_join(g_pool.threads[i], NULL);
+    coom_free(g_pool.threads);
+    g_pool.threads = NULL;
+    g_pool.count   = 0;
+    g_pool.started = g_pool.quit = false;
+}
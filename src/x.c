@@ -1,5 +1,13 @@
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
 #include "coomer.h"
 
+u32 coom_gl_calls      = 0;
+u32 coom_x_round_trips = 0;
+
 static int coom_xerror_handler(Display *d, XErrorEvent *e) {
     char *temp = temp_alloc(1 << 10);
     XGetErrorText(d, e->error_code, temp, 1 << 10);
@@ -37,18 +45,164 @@ defer:
     XFreeCursor(d, cursor);
     return result;
 }
+static void coom_draw_region_outline(Display *d, GC gc, vec2_t a, vec2_t b) {
+    int x = fminf(a.x, b.x), y = fminf(a.y, b.y);
+    int w = fabsf(a.x - b.x), h = fabsf(a.y - b.y);
+    XDrawRectangle(d, DefaultRootWindow(d), gc, x, y, w, h);
+}
+
+bool coom_select_region(Display *d, coom_rect *out) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    Window    root   = DefaultRootWindow(d);
+    Cursor    cursor = XCreateFontCursor(d, XC_crosshair);
+    XGCValues gcv    = {
+        .function       = GXxor,
+        .foreground     = WhitePixel(d, DefaultScreen(d)) ^ BlackPixel(d, DefaultScreen(d)),
+        .line_width     = 1,
+        .subwindow_mode = IncludeInferiors,
+    };
+    GC   gc     = XCreateGC(d, root, GCFunction | GCForeground | GCLineWidth | GCSubwindowMode, &gcv);
+    bool result = false;
+
+    XGrabPointer(d, root, 0, ButtonMotionMask | ButtonPressMask | ButtonReleaseMask, GrabModeAsync, GrabModeAsync, root, cursor, CurrentTime);
+    XGrabKeyboard(d, root, 0, GrabModeAsync, GrabModeAsync, CurrentTime);
+
+    bool   pressed = false;
+    vec2_t start = vec2(0, 0), end = vec2(0, 0);
+    XEvent event;
+    while (true) {
+        XNextEvent(d, &event);
+        switch (event.type) {
+            case ButtonPress:
+                pressed = true;
+                start = end = vec2(event.xbutton.x_root, event.xbutton.y_root);
+                coom_draw_region_outline(d, gc, start, end);
+                break;
+            case MotionNotify:
+                if (!pressed) break;
+                // only the latest position matters, skip the queued ones
+                while (XCheckTypedEvent(d, MotionNotify, &event)) {}
+                coom_draw_region_outline(d, gc, start, end);  // xor twice erases it
+                end = vec2(event.xmotion.x_root, event.xmotion.y_root);
+                coom_draw_region_outline(d, gc, start, end);
+                break;
+            case ButtonRelease:
+                if (!pressed) break;
+                coom_draw_region_outline(d, gc, start, end);
+                end    = vec2(event.xbutton.x_root, event.xbutton.y_root);
+                *out   = (coom_rect){.x = fminf(start.x, end.x), .y = fminf(start.y, end.y), .w = fabsf(start.x - end.x), .h = fabsf(start.y - end.y)};
+                result = out->w > 0 && out->h > 0;
+                goto defer;
+            case KeyPress:
+                if (pressed) coom_draw_region_outline(d, gc, start, end);
+                goto defer;
+        }
+        XFlush(d);
+    }
+
+defer:
+    XUngrabKeyboard(d, CurrentTime);
+    XUngrabPointer(d, CurrentTime);
+    XFreeGC(d, gc);
+    XFreeCursor(d, cursor);
+    // the outline has to be gone from the screen before anything captures it
+    XSync(d, False);
+    return result;
+}
+
+coom_rect coom_window_rect(Display *d, Window w) {
+    XWindowAttributes attr = {0};
+    XGetWindowAttributes(d, w, &attr);
+    return (coom_rect){.x = 0, .y = 0, .w = attr.width, .h = attr.height};
+}
+
+bool coom_find_monitor(Display *d, const char *query, coom_rect *out) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    Window              root   = DefaultRootWindow(d);
+    XRRScreenResources *res    = XRRGetScreenResourcesCurrent(d, root);
+    bool                result = false;
+    if (res == NULL) {
+        coom_error("failed to get XRandR screen resources");
+        return false;
+    }
+
+    bool   by_cursor = strcmp(query, "cursor") == 0;
+    vec2_t cursor    = by_cursor ? coom_mouse_pos(d) : vec2(0, 0);
+    char  *end       = NULL;
+    long   index     = strtol(query, &end, 10);
+    bool   by_index  = end != query && *end == '\0';
+
+    int    active    = 0;
+    for (int i = 0; i < res->noutput && !result; ++i) {
+        XRROutputInfo *output = XRRGetOutputInfo(d, res, res->outputs[i]);
+        if (output == NULL) continue;
+        if (output->connection != RR_Connected || output->crtc == None) {
+            XRRFreeOutputInfo(output);
+            continue;
+        }
+        XRRCrtcInfo *crtc = XRRGetCrtcInfo(d, res, output->crtc);
+        if (crtc != NULL) {
+            coom_rect r = {.x = crtc->x, .y = crtc->y, .w = crtc->width, .h = crtc->height};
+            coom_info("monitor %d: %s %dx%d+%d+%d", active, output->name, r.w, r.h, r.x, r.y);
+            if (by_cursor) result = r.x <= cursor.x && cursor.x < r.x + r.w && r.y <= cursor.y && cursor.y < r.y + r.h;
+            else if (by_index) result = active == index;
+            else result = strcmp(output->name, query) == 0;
+            if (result) *out = r;
+            active += 1;
+            XRRFreeCrtcInfo(crtc);
+        }
+        XRRFreeOutputInfo(output);
+    }
+    XRRFreeScreenResources(res);
+    if (!result) coom_error("no active monitor matches '%s'", query);
+    return result;
+}
+
 short coom_get_monitor_rate(Display *d) {
     coom_info("%s", __PRETTY_FUNCTION__);
     XRRScreenConfiguration *screen_cfg = XRRGetScreenInfo(d, DefaultRootWindow(d));
     short                   rate       = XRRConfigCurrentRate(screen_cfg);
     XRRFreeScreenConfigInfo(screen_cfg);
+    if (rate <= 0) {
+        // Xvfb and most VNC servers
+        coom_warning("XRandR reports a %d Hz refresh rate, assuming %d Hz", rate, COOM_DEFAULT_RATE);
+        rate = COOM_DEFAULT_RATE;
+    }
     return rate;
 }
 
-static GLuint coom_new_shader(const strview shader, GLenum kind) {
+bool coom_set_swap_interval(Display *d, GLXDrawable drawable, coom_vsync vsync) {
     coom_info("%s", __PRETTY_FUNCTION__);
-    GLuint result = glCreateShader(kind);
-    glShaderSource(result, 1, &shader.data, NULL);
+    const char *exts = glXQueryExtensionsString(d, DefaultScreen(d));
+    int interval = vsync == COOM_VSYNC_OFF ? 0 : 1;
+    if (vsync == COOM_VSYNC_ADAPTIVE) {
+        if (coom_has_extension(exts, "GLX_EXT_swap_control_tear")) interval = -1;
+        else coom_warning("adaptive vsync needs GLX_EXT_swap_control_tear, using plain vsync");
+    }
+    if (coom_has_extension(exts, "GLX_EXT_swap_control")) {
+        PFNGLXSWAPINTERVALEXTPROC swap_interval = (PFNGLXSWAPINTERVALEXTPROC)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalEXT");
+        swap_interval(d, drawable, interval);
+        coom_info("swap interval %d through GLX_EXT_swap_control", interval);
+        return true;
+    }
+    if (coom_has_extension(exts, "GLX_MESA_swap_control")) {
+        // no late swap tearing here
+        PFNGLXSWAPINTERVALMESAPROC swap_interval = (PFNGLXSWAPINTERVALMESAPROC)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalMESA");
+        if (swap_interval(interval != 0) == 0) {
+            coom_info("swap interval %d through GLX_MESA_swap_control", interval != 0);
+            return true;
+        }
+    }
+    coom_warning("no usable GLX swap control extension");
+    return false;
+}
+
+// `defines` goes between the version line and the source, it selects the variant
+static GLuint coom_new_shader(const char *defines, const strview shader, GLenum kind) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    GLuint      result    = glCreateShader(kind);
+    const char *source[3] = {"#version 140\n", defines, shader.data};
+    glShaderSource(result, 3, source, NULL);
     glCompileShader(result);
 
     GLint success;
@@ -62,49 +216,116 @@ static GLuint coom_new_shader(const strview shader, GLenum kind) {
     return result;
 }
 
-static GLuint coom_new_shader_prog(void) {
-    coom_info("%s", __PRETTY_FUNCTION__);
-    GLuint prog = glCreateProgram();
-    GLuint vertex_shader =
-        coom_new_shader(SV("#version 130\n"
-                           "in vec3 aPos;"
-                           "in vec2 aTexCoord;"
-                           "out vec2 texcoord;"
-                           "uniform vec2 cameraPos;"
-                           "uniform float cameraScale;"
-                           "uniform vec2 windowSize;"
-                           "uniform vec2 screenshotSize;"
-                           "uniform vec2 cursorPos;"
-                           "vec3 to_world(vec3 v) {"
-                           "vec2 ratio = vec2(windowSize.x / screenshotSize.x / cameraScale, windowSize.y / screenshotSize.y / cameraScale);"
-                           "   return vec3((v.x / screenshotSize.x * 2.0 - 1.0) / ratio.x, (v.y / screenshotSize.y * 2.0 - 1.0) / ratio.y, v.z);"
-                           "}"
-                           "void main() {"
-                           "   gl_Position = vec4(to_world((aPos - vec3(cameraPos * vec2(1.0, -1.0), 0.0))), 1.0);"
-                           "   texcoord = aTexCoord;"
-                           "}\0"),
-                        GL_VERTEX_SHADER);
-    GLuint fragment_shader = coom_new_shader(
-        SV("#version 130\n"
-           "out mediump vec4 color;"
-           "in mediump vec2 texcoord;"
-           "uniform sampler2D tex;"
-           "uniform vec2 cursorPos;"
-           "uniform vec2 windowSize;"
-           "uniform float flShadow;"
-           "uniform float flRadius;"
-           "uniform float cameraScale;"
-           "void main() {"
-           "   vec4 cursor = vec4(cursorPos.x, windowSize.y - cursorPos.y, 0.0, 1.0);"
-           "   color = mix(texture(tex, texcoord), vec4(0.0, 0.0, 0.0, 0.0), length(cursor - gl_FragCoord) < (flRadius * cameraScale) ? 0.0 : flShadow);"
-           "}\0"),
-
-        GL_FRAGMENT_SHADER);
+// per-frame state shared by both stages, laid out like coom_frame_uniforms
+#define COOM_FRAME_UNIFORMS   \
+    "layout(std140) uniform Frame {" \
+    "   vec2 cameraPos;"      \
+    "   vec2 windowSize;"     \
+    "   vec2 screenshotSize;" \
+    "   vec2 cursorPos;"      \
+    "   float cameraScale;"   \
+    "   float flShadow;"      \
+    "   float flRadius;"      \
+    "};"
+
+const char *coom_shader_variant_name(int variant) {
+    static const char *sampling[COOM_FILTER_COUNT + 1] = {"filtered", "nearest", "bicubic", "lanczos2", "lanczos3"};
+    static const char *overlays[4]                     = {"", "flashlight ", "grid ", "flashlight grid "};
+    static char        names[COOM_SHADER_VARIANTS][32];
+    if (names[variant][0] == '\0') snprintf(names[variant], sizeof(names[variant]), "%s%s", overlays[variant & 3], sampling[COOM_SHADER_SAMPLING(variant)]);
+    return names[variant];
+}
+
+static GLuint coom_new_shader_prog(GLuint vertex_shader, int variant) {
+    coom_info("%s %s", __PRETTY_FUNCTION__, coom_shader_variant_name(variant));
+    static const char *sampling[COOM_FILTER_COUNT + 1] = {
+        "",
+        "#define NEAREST\n",
+        "#define BICUBIC\n#define RADIUS 2\n",
+        "#define LANCZOS\n#define RADIUS 2\n",
+        "#define LANCZOS\n#define RADIUS 3\n",
+    };
+    char defines[128] = {0};
+    if (variant & COOM_SHADER_FLASHLIGHT) strcat(defines, "#define FLASHLIGHT\n");
+    if (variant & COOM_SHADER_GRID) strcat(defines, "#define GRID\n");
+    strcat(defines, sampling[COOM_SHADER_SAMPLING(variant)]);
+    GLuint prog            = glCreateProgram();
+    GLuint fragment_shader = coom_new_shader(defines,
+                                             SV("out mediump vec4 color;"
+                                                "in mediump vec2 texcoord;"
+                                                "uniform sampler2D tex;" COOM_FRAME_UNIFORMS "\n"
+                                                "#ifdef RADIUS\n"
+                                                "float weight(float x) {\n"
+                                                "#ifdef BICUBIC\n"
+                                                // Catmull-Rom, the sharpest of the cubics that still goes through the texels
+                                                "   x = abs(x);"
+                                                "   return x < 1.0 ? (1.5 * x - 2.5) * x * x + 1.0 : x < 2.0 ? ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0 : 0.0;\n"
+                                                "#else\n"
+                                                "   if (abs(x) < 1e-5) return 1.0;"
+                                                "   if (abs(x) >= float(RADIUS)) return 0.0;"
+                                                "   x *= 3.14159265;"
+                                                "   return float(RADIUS) * sin(x) * sin(x / float(RADIUS)) / (x * x);\n"
+                                                "#endif\n"
+                                                "}"
+                                                "vec2 weights(vec2 x) { return vec2(weight(x.x), weight(x.y)); }"
+                                                // The two texels around p weigh positive on both axes, one bilinear fetch between
+                                                // them replaces four texel fetches. Every tile is its own texture, so the kernel is
+                                                // clamped at the tile edges.
+                                                "vec4 reconstruct() {"
+                                                "   vec2 size = vec2(textureSize(tex, 0));"
+                                                "   vec2 p    = texcoord * size - 0.5;"
+                                                "   vec2 f    = fract(p);"
+                                                "   vec2 c    = floor(p) + 0.5;"
+                                                "   vec2 w[2 * RADIUS - 1], o[2 * RADIUS - 1];"
+                                                "   for (int i = 0; i < RADIUS - 1; ++i) {"
+                                                "       float d = float(RADIUS - 1 - i);"
+                                                "       w[i] = weights(-d - f);"
+                                                "       o[i] = c - d;"
+                                                "       w[2 * RADIUS - 2 - i] = weights(1.0 + d - f);"
+                                                "       o[2 * RADIUS - 2 - i] = c + 1.0 + d;"
+                                                "   }"
+                                                "   vec2 w0 = weights(-f), w1 = weights(1.0 - f);"
+                                                "   w[RADIUS - 1] = w0 + w1;"
+                                                "   o[RADIUS - 1] = c + w1 / (w0 + w1);"
+                                                "   vec4  sum   = vec4(0.0);"
+                                                "   float total = 0.0;"
+                                                "   for (int y = 0; y < 2 * RADIUS - 1; ++y) {"
+                                                "       for (int x = 0; x < 2 * RADIUS - 1; ++x) {"
+                                                "           float k = w[x].x * w[y].y;"
+                                                "           sum += k * textureLod(tex, vec2(o[x].x, o[y].y) / size, 0.0);"
+                                                "           total += k;"
+                                                "       }"
+                                                "   }"
+                                                // the negative lobes overshoot around sharp edges
+                                                "   return clamp(sum / total, 0.0, 1.0);"
+                                                "}\n"
+                                                "#endif\n"
+                                                "void main() {\n"
+                                                "#if defined(RADIUS)\n"
+                                                "   color = reconstruct();\n"
+                                                // magnified texels are plain copies, no need to go through the sampler
+                                                "#elif defined(NEAREST)\n"
+                                                "   ivec2 size = textureSize(tex, 0);"
+                                                "   color = texelFetch(tex, min(ivec2(texcoord * vec2(size)), size - 1), 0);\n"
+                                                "#else\n"
+                                                "   color = texture(tex, texcoord);\n"
+                                                "#endif\n"
+                                                // one window pixel wide lines on the texel edges, half grey shows on black and white
+                                                "#ifdef GRID\n"
+                                                "   vec2 texel = texcoord * vec2(textureSize(tex, 0));"
+                                                "   if (any(lessThan(fract(texel), fwidth(texel)))) color = mix(color, vec4(0.5, 0.5, 0.5, 1.0), 0.5);\n"
+                                                "#endif\n"
+                                                "#ifdef FLASHLIGHT\n"
+                                                "   vec4 cursor = vec4(cursorPos.x, windowSize.y - cursorPos.y, 0.0, 1.0);"
+                                                "   color = mix(color, vec4(0.0, 0.0, 0.0, 0.0), length(cursor - gl_FragCoord) < (flRadius * cameraScale) ? 0.0 : flShadow);\n"
+                                                "#endif\n"
+                                                "}\0"),
+                                             GL_FRAGMENT_SHADER);
 
     glAttachShader(prog, vertex_shader);
     glAttachShader(prog, fragment_shader);
     glLinkProgram(prog);
-    glDeleteShader(vertex_shader);
+    glDetachShader(prog, vertex_shader);
     glDeleteShader(fragment_shader);
     GLint success;
     glGetProgramiv(prog, GL_LINK_STATUS, &success);
@@ -114,24 +335,63 @@ static GLuint coom_new_shader_prog(void) {
         coom_error("during linking prog: %s", temp);
         temp_free(512);
     }
+    // everything else lives in the uniform block, nothing is looked up per frame
     glUseProgram(prog);
+    glUniform1i(glGetUniformLocation(prog, "tex"), 0);
+    glUniformBlockBinding(prog, glGetUniformBlockIndex(prog, "Frame"), COOM_FRAME_BINDING);
     return prog;
 }
 
-GLuint coom_initialize_shader(GLuint *vao, GLuint *vbo, GLuint *ebo, XImage *img) {
+void coom_use_shader(coom_shaders *shaders, int variant) {
+    if (shaders->progs[variant] == 0) {
+        f64 start               = coom_time_now();
+        shaders->progs[variant] = coom_new_shader_prog(shaders->vertex, variant);
+        coom_info("%s shader built in %.2f ms", coom_shader_variant_name(variant), (coom_time_now() - start) * 1000.0);
+    } else {
+        COOM_GL(glUseProgram(shaders->progs[variant]));
+    }
+    shaders->bound = variant;
+}
+
+void coom_initialize_shader(coom_shaders *shaders, GLuint *vao, GLuint *vbo, GLuint *ebo, GLuint *ubo, const coom_texture *tex) {
     coom_info("%s", __PRETTY_FUNCTION__);
-    assert(img);
-    GLuint  shader_program = coom_new_shader_prog();
-    GLfloat w              = img->width;
-    GLfloat h              = img->height;
+    *shaders             = (coom_shaders){0};
+    GLuint vertex_shader = coom_new_shader("",
+                                           SV("in vec3 aPos;"
+                                              "in vec2 aTexCoord;"
+                                              "out vec2 texcoord;" COOM_FRAME_UNIFORMS
+                                              "vec3 to_world(vec3 v) {"
+                                              "vec2 ratio = vec2(windowSize.x / screenshotSize.x / cameraScale, windowSize.y / screenshotSize.y / cameraScale);"
+                                              "   return vec3((v.x / screenshotSize.x * 2.0 - 1.0) / ratio.x, (v.y / screenshotSize.y * 2.0 - 1.0) / ratio.y, v.z);"
+                                              "}"
+                                              "void main() {"
+                                              "   gl_Position = vec4(to_world((aPos - vec3(cameraPos * vec2(1.0, -1.0), 0.0))), 1.0);"
+                                              "   texcoord = aTexCoord;"
+                                              "}\0"),
+                                           GL_VERTEX_SHADER);
+    // kept around to link the variants that were not asked for yet
+    shaders->vertex = vertex_shader;
+    coom_use_shader(shaders, 0);
+    GLfloat h = tex->height;
 
-    GLfloat vertices[4][5] = {
-        {w, 0, 0.0, 1.0, 1.0},  // Top right
-        {w, h, 0.0, 1.0, 0.0},  // Bottom right
-        {0, h, 0.0, 0.0, 0.0},  // Bottom left
-        {0, 0, 0.0, 0.0, 1.0}   // Top left
-    };
-    GLuint indicies[] = {0, 1, 3, 1, 2, 3};
+    // one quad per tile, in capture pixels with y going up
+    GLfloat(*vertices)[5] = coom_alloc(NULL, tex->count * 4 * sizeof(*vertices));
+    GLuint *indicies      = coom_alloc(NULL, tex->count * 6 * sizeof(*indicies));
+    for (usize i = 0; i < tex->count; ++i) {
+        coom_rect r          = tex->tiles[i].rect;
+        GLfloat   x0         = r.x, x1 = r.x + r.w;
+        GLfloat   y0         = h - (r.y + r.h), y1 = h - r.y;
+        GLfloat   quad[4][5] = {
+            {x1, y0, 0.0, 1.0, 1.0},  // Top right
+            {x1, y1, 0.0, 1.0, 0.0},  // Bottom right
+            {x0, y1, 0.0, 0.0, 0.0},  // Bottom left
+            {x0, y0, 0.0, 0.0, 1.0}   // Top left
+        };
+        GLuint base            = i * 4;
+        GLuint quad_indicies[] = {base + 0, base + 1, base + 3, base + 1, base + 2, base + 3};
+        memcpy(vertices[i * 4], quad, sizeof(quad));
+        memcpy(&indicies[i * 6], quad_indicies, sizeof(quad_indicies));
+    }
 
     glGenVertexArrays(1, vao);
     glGenBuffers(1, vbo);
@@ -140,39 +400,327 @@ GLuint coom_initialize_shader(GLuint *vao, GLuint *vbo, GLuint *ebo, XImage *img
     glBindVertexArray(*vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, *vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, tex->count * 4 * sizeof(*vertices), vertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indicies), &indicies, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, tex->count * 6 * sizeof(*indicies), indicies, GL_STATIC_DRAW);
     GLsizei stride = sizeof(vertices[0]);
     glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, 0);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(1, 2, GL_FLOAT, false, stride, (void *)(3 * sizeof(GLfloat)));
     glEnableVertexAttribArray(1);
+    coom_free(vertices);
+    coom_free(indicies);
 
-    GLuint texture = 0;
-    glGenTextures(1, &texture);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, img->data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glUniform1i(glGetUniformLocation(shader_program, "tex"), 0);
-
-    glEnable(GL_TEXTURE_2D);
+    coom_frame_uniforms zero = {0};
+    glGenBuffers(1, ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, *ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(zero), &zero, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, COOM_FRAME_BINDING, *ubo);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    return shader_program;
+    glClearColor(0.1, 0.1, 0.1, 1.0);
 }
 
-void coom_uninitialize_shader(GLuint *vao, GLuint *vbo, GLuint *ebo, GLuint *program) {
+void coom_uninitialize_shader(coom_shaders *shaders, GLuint *vao, GLuint *vbo, GLuint *ebo, GLuint *ubo) {
     coom_info("%s", __PRETTY_FUNCTION__);
+    glDeleteBuffers(1, ubo);
     glDeleteVertexArrays(1, vao);
     glDeleteBuffers(1, vbo);
     glDeleteBuffers(1, ebo);
-    glDeleteProgram(*program);
+    for (int i = 0; i < COOM_SHADER_VARIANTS; ++i) glDeleteProgram(shaders->progs[i]);
+    glDeleteShader(shaders->vertex);
+    *shaders = (coom_shaders){0};
+}
+
+static bool coom_gl_has_extension(const char *name) {
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for (GLint i = 0; i < extensions; ++i) {
+        const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0) return true;
+    }
+    return false;
+}
+
+void coom_gpu_timer_init(coom_gpu_timer *t) {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    *t           = (coom_gpu_timer){0};
+    t->supported = major > 3 || (major == 3 && minor >= 3) || coom_gl_has_extension("GL_ARB_timer_query");
+    if (t->supported) glGenQueries(COOM_GPU_QUERIES, t->ids);
+    else coom_warning("no GL_ARB_timer_query, shader variants are not timed");
+}
+
+void coom_gpu_timer_uninit(coom_gpu_timer *t) {
+    if (t->supported) glDeleteQueries(COOM_GPU_QUERIES, t->ids);
+    *t = (coom_gpu_timer){0};
+}
+
+void coom_gpu_timer_collect(coom_gpu_timer *t, bool wait) {
+    for (usize i = 0; i < COOM_GPU_QUERIES; ++i) {
+        if (!t->pending[i]) continue;
+        GLuint available = GL_TRUE;
+        if (!wait) COOM_GL(glGetQueryObjectuiv(t->ids[i], GL_QUERY_RESULT_AVAILABLE, &available));
+        if (!available) continue;
+        GLuint64 elapsed = 0;
+        COOM_GL(glGetQueryObjectui64v(t->ids[i], GL_QUERY_RESULT, &elapsed));
+        t->time[t->variant[i]] += elapsed;
+        t->frames[t->variant[i]] += 1;
+        t->pending[i] = false;
+    }
+}
+
+void coom_gpu_timer_begin(coom_gpu_timer *t, int variant) {
+    t->active = false;
+    if (!t->supported) return;
+    coom_gpu_timer_collect(t, false);
+    // the oldest query is still in flight, skip this frame rather than stall on it
+    if (t->pending[t->next]) return;
+    COOM_GL(glBeginQuery(GL_TIME_ELAPSED, t->ids[t->next]));
+    t->variant[t->next] = variant;
+    t->active           = true;
+}
+
+void coom_gpu_timer_end(coom_gpu_timer *t) {
+    if (!t->active) return;
+    COOM_GL(glEndQuery(GL_TIME_ELAPSED));
+    t->pending[t->next] = true;
+    t->next             = (t->next + 1) % COOM_GPU_QUERIES;
+    t->active           = false;
+}
+
+void coom_update_uniforms(GLuint ubo, coom_frame_uniforms *uploaded, const coom_frame_uniforms *next) {
+    const u32 *prev = (const u32 *)uploaded, *curr = (const u32 *)next;
+    usize      count = sizeof(coom_frame_uniforms) / sizeof(u32), first = count, last = 0;
+    for (usize i = 0; i < count; ++i) {
+        if (prev[i] == curr[i]) continue;
+        if (first == count) first = i;
+        last = i;
+    }
+    if (first == count) return;
+    COOM_GL(glBindBuffer(GL_UNIFORM_BUFFER, ubo));
+    COOM_GL(glBufferSubData(GL_UNIFORM_BUFFER, first * sizeof(u32), (last - first + 1) * sizeof(u32), &curr[first]));
+    *uploaded = *next;
+}
+
+void coom_initialize_texture(coom_texture *tex, int width, int height) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    tex->width     = width;
+    tex->height    = height;
+    tex->tile_size = max_size > 0 && max_size < COOM_TILE_SIZE ? max_size : COOM_TILE_SIZE;
+
+    int cols       = (width + tex->tile_size - 1) / tex->tile_size;
+    int rows       = (height + tex->tile_size - 1) / tex->tile_size;
+    tex->count     = (usize)cols * rows;
+    tex->tiles     = coom_alloc(NULL, tex->count * sizeof(coom_tile));
+    coom_info("texture %dx%d split into %dx%d tiles of %d (GL_MAX_TEXTURE_SIZE = %d)", width, height, cols, rows, tex->tile_size, max_size);
+
+    if (coom_gl_has_extension("GL_EXT_texture_filter_anisotropic")) glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &tex->anisotropy);
+
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_TEXTURE_2D);
+    // PBO rows are packed tightly, a 16-bit capture with an odd width is not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int row = 0; row < rows; ++row) {
+        for (int col = 0; col < cols; ++col) {
+            coom_tile *tile = &tex->tiles[row * cols + col];
+            tile->rect.x    = col * tex->tile_size;
+            tile->rect.y    = row * tex->tile_size;
+            tile->rect.w    = width - tile->rect.x < tex->tile_size ? width - tile->rect.x : tex->tile_size;
+            tile->rect.h    = height - tile->rect.y < tex->tile_size ? height - tile->rect.y : tex->tile_size;
+
+            glGenTextures(1, &tile->id);
+            glBindTexture(GL_TEXTURE_2D, tile->id);
+            tile->min_filter = GL_NEAREST;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            // nearest magnification goes through texelFetch, the linear sampler serves the bicubic and lanczos taps
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            // tiles meet edge to edge, a border color would show up as seams between them
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+    }
+    if (!tex->client_upload) glGenBuffers(2, tex->pbo);
+}
+
+// match the upload to the XImage layout, a mismatch between format and internal format makes
+// Mesa repack every pixel on the CPU
+static void coom_pick_texture_format(coom_texture *tex, XImage *img) {
+    bool native = (img->byte_order == LSBFirst) == (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+    if (img->bits_per_pixel == 32 && img->red_mask == 0xff0000 && img->green_mask == 0x00ff00 && img->blue_mask == 0x0000ff) {
+        tex->internal_format = GL_RGBA8;
+        tex->format          = GL_BGRA;
+        tex->type            = native ? GL_UNSIGNED_INT_8_8_8_8_REV : GL_UNSIGNED_INT_8_8_8_8;
+    } else if (img->bits_per_pixel == 32 && img->red_mask == 0x0000ff && img->green_mask == 0x00ff00 && img->blue_mask == 0xff0000) {
+        tex->internal_format = GL_RGBA8;
+        tex->format          = GL_RGBA;
+        tex->type            = native ? GL_UNSIGNED_INT_8_8_8_8_REV : GL_UNSIGNED_INT_8_8_8_8;
+    } else if (img->bits_per_pixel == 16 && img->red_mask == 0xf800 && img->green_mask == 0x07e0 && img->blue_mask == 0x001f && native) {
+        tex->internal_format = GL_RGB565;
+        tex->format          = GL_RGB;
+        tex->type            = GL_UNSIGNED_SHORT_5_6_5;
+    } else {
+        coom_warning("unexpected visual (%d bpp, masks %06lx %06lx %06lx), uploading as BGRA", img->bits_per_pixel, img->red_mask, img->green_mask, img->blue_mask);
+        tex->internal_format = GL_RGBA8;
+        tex->format          = GL_BGRA;
+        tex->type            = GL_UNSIGNED_BYTE;
+    }
+}
+
+void coom_upload_texture(coom_texture *tex, XImage *img) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    assert(img && img->width == tex->width && img->height == tex->height);
+    coom_pick_texture_format(tex, img);
+    for (usize i = 0; i < tex->count; ++i) {
+        coom_tile *tile   = &tex->tiles[i];
+        int        side   = tile->rect.w > tile->rect.h ? tile->rect.w : tile->rect.h;
+        // immutable storage, the mip levels are reserved here and only filled once zoomed out
+        GLsizei    levels = 1 + (GLsizei)floor(log2(side));
+        glBindTexture(GL_TEXTURE_2D, tile->id);
+        glTexStorage2D(GL_TEXTURE_2D, levels, tex->internal_format, tile->rect.w, tile->rect.h);
+    }
+
+    f64 start = coom_time_now();
+    coom_update_texture(tex, img, 0, 0, img->width, img->height);
+    coom_info("texture upload (%s) blocked for %.2f ms", tex->client_upload ? "client memory" : "pbo", (coom_time_now() - start) * 1000.0);
+}
+
+void coom_uninitialize_texture(coom_texture *tex) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    if (!tex->client_upload) glDeleteBuffers(2, tex->pbo);
+    for (usize i = 0; i < tex->count; ++i) glDeleteTextures(1, &tex->tiles[i].id);
+    coom_free(tex->tiles);
+    tex->tiles = NULL;
+    tex->count = 0;
+}
+
+// (x, y) is the position in the capture, (tx, ty) the same position inside the tile
+static void coom_update_tile_client(GLuint id, GLenum format, GLenum type, XImage *img, int x, int y, int tx, int ty, int w, int h) {
+    COOM_GL(glBindTexture(GL_TEXTURE_2D, id));
+    COOM_GL(glPixelStorei(GL_UNPACK_ROW_LENGTH, img->bytes_per_line / (img->bits_per_pixel / 8)));
+    COOM_GL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, x));
+    COOM_GL(glPixelStorei(GL_UNPACK_SKIP_ROWS, y));
+    COOM_GL(glTexSubImage2D(GL_TEXTURE_2D, 0, tx, ty, w, h, format, type, img->data));
+    COOM_GL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+    COOM_GL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0));
+    COOM_GL(glPixelStorei(GL_UNPACK_SKIP_ROWS, 0));
+}
+
+static void coom_update_tile(coom_texture *tex, GLuint id, XImage *img, int x, int y, int tx, int ty, int w, int h) {
+    if (tex->client_upload) {
+        coom_update_tile_client(id, tex->format, tex->type, img, x, y, tx, ty, w, h);
+        return;
+    }
+
+    int   i     = tex->pbo_next;
+    usize pitch = (usize)w * (img->bits_per_pixel / 8);
+    usize size  = pitch * h;
+    COOM_GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tex->pbo[i]));
+    if (size > tex->pbo_size[i]) {
+        COOM_GL(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW));
+        tex->pbo_size[i] = size;
+    }
+    // invalidating lets the driver hand out fresh storage instead of waiting for the previous transfer
+    u8 *dst = COOM_GL(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (dst == NULL) {
+        coom_warning("failed to map pixel buffer, falling back to client memory uploads");
+        COOM_GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+        COOM_GL(glDeleteBuffers(2, tex->pbo));
+        tex->client_upload = true;
+        coom_update_tile_client(id, tex->format, tex->type, img, x, y, tx, ty, w, h);
+        return;
+    }
+    const u8 *src = (const u8 *)img->data + (usize)y * img->bytes_per_line + (usize)x * (img->bits_per_pixel / 8);
+    for (int row = 0; row < h; ++row) memcpy(dst + row * pitch, src + (usize)row * img->bytes_per_line, pitch);
+    COOM_GL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+    COOM_GL(glBindTexture(GL_TEXTURE_2D, id));
+    COOM_GL(glTexSubImage2D(GL_TEXTURE_2D, 0, tx, ty, w, h, tex->format, tex->type, (void *)0));
+    COOM_GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    tex->pbo_next = !i;
+}
+
+void coom_update_texture(coom_texture *tex, XImage *img, int x, int y, int w, int h) {
+    for (usize i = 0; i < tex->count; ++i) {
+        coom_rect t  = tex->tiles[i].rect;
+        int       x0 = x > t.x ? x : t.x, y0 = y > t.y ? y : t.y;
+        int       x1 = x + w < t.x + t.w ? x + w : t.x + t.w;
+        int       y1 = y + h < t.y + t.h ? y + h : t.y + t.h;
+        if (x1 <= x0 || y1 <= y0) continue;
+        coom_update_tile(tex, tex->tiles[i].id, img, x0, y0, x0 - t.x, y0 - t.y, x1 - x0, y1 - y0);
+        tex->tiles[i].mipmapped = false;
+    }
+}
+
+bool coom_update_texture_filter(coom_texture *tex, f32 scale) {
+    bool minify  = scale < 1.0;
+    bool built   = false;
+    bool pending = false;
+    for (usize i = 0; i < tex->count; ++i) {
+        coom_tile *tile   = &tex->tiles[i];
+        GLint      filter = GL_NEAREST;
+        if (minify) {
+            if (!tile->mipmapped && built) pending = true;
+            if (!tile->mipmapped && !built) {
+                f64 start = coom_time_now();
+                COOM_GL(glBindTexture(GL_TEXTURE_2D, tile->id));
+                COOM_GL(glGenerateMipmap(GL_TEXTURE_2D));
+                tile->mipmapped = built = true;
+                coom_info("built mip chain of tile %zu in %.2f ms", i, (coom_time_now() - start) * 1000.0);
+            }
+            // a stale chain would show old content when zoomed out, stay on level 0 until it is rebuilt
+            filter = tile->mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+        }
+        if (tile->min_filter == filter) continue;
+        COOM_GL(glBindTexture(GL_TEXTURE_2D, tile->id));
+        COOM_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter));
+        if (tex->anisotropy > 1.0) COOM_GL(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, filter == GL_LINEAR_MIPMAP_LINEAR ? tex->anisotropy : 1.0));
+        tile->min_filter = filter;
+    }
+    return pending;
+}
+
+usize coom_draw_texture(const coom_texture *tex, coom_rect visible) {
+    usize drawn = 0;
+    for (usize i = 0; i < tex->count; ++i) {
+        coom_rect t = tex->tiles[i].rect;
+        if (t.x >= visible.x + visible.w || visible.x >= t.x + t.w || t.y >= visible.y + visible.h || visible.y >= t.y + t.h) continue;
+        COOM_GL(glBindTexture(GL_TEXTURE_2D, tex->tiles[i].id));
+        COOM_GL(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void *)(i * 6 * sizeof(GLuint))));
+        drawn += 1;
+    }
+    return drawn;
+}
+
+void coom_wait_display(Display *dpy, int fd, int timeout) {
+    struct pollfd fds[2] = {{.fd = ConnectionNumber(dpy), .events = POLLIN}, {.fd = fd, .events = POLLIN}};
+    XFlush(dpy);
+    while (XPending(dpy) == 0) {
+        int ready = poll(fds, fd < 0 ? 1 : 2, timeout);
+        if (ready < 0 && errno != EINTR) {
+            coom_error("poll on the X connection failed - %s", strerror(errno));
+            return;
+        }
+        // the caller drains `fd` itself, one readable byte is enough to return
+        if (ready == 0 || (fd >= 0 && (fds[1].revents & POLLIN))) return;
+    }
+}
+
+bool coom_shape_circle(Display *d, Window win, int size) {
+    int event_base, error_base;
+    if (!XShapeQueryExtension(d, &event_base, &error_base)) return false;
+    Pixmap mask = XCreatePixmap(d, win, size, size, 1);
+    GC     gc   = XCreateGC(d, mask, 0, NULL);
+    XSetForeground(d, gc, 0);
+    XFillRectangle(d, mask, gc, 0, 0, size, size);
+    XSetForeground(d, gc, 1);
+    XFillArc(d, mask, gc, 0, 0, size, size, 0, 360 * 64);
+    XShapeCombineMask(d, win, ShapeBounding, 0, 0, mask, ShapeSet);
+    XFreeGC(d, gc);
+    XFreePixmap(d, mask);
+    return true;
 }
 
 vec2_t coom_mouse_pos(Display *dpy) {
@@ -184,20 +732,176 @@ vec2_t coom_mouse_pos(Display *dpy) {
     return vec2(root_x, root_y);
 }
 
-XImage *coom_new_screenshot(Display *dpy, Window win) {
+// the error handler is process wide, while a capture thread attaches its segment the main
+// thread may still be talking to the server on another connection
+static Display      *g_shm_display       = NULL;
+static bool          g_shm_attach_failed = false;
+static XErrorHandler g_shm_prev_handler  = NULL;
+static int           coom_shm_error_handler(Display *d, XErrorEvent *e) {
+    if (d != g_shm_display) return g_shm_prev_handler ? g_shm_prev_handler(d, e) : 0;
+    g_shm_attach_failed = true;
+    return 0;
+}
+
+XImage *coom_new_shm_image(Display *dpy, Visual *visual, int depth, int width, int height) {
+    if (!XShmQueryExtension(dpy)) return NULL;
+
+    XShmSegmentInfo *shminfo = coom_alloc(NULL, sizeof(XShmSegmentInfo));
+    memset(shminfo, 0, sizeof(XShmSegmentInfo));
+    shminfo->shmid = -1;
+
+    XImage *img    = XShmCreateImage(dpy, visual, depth, ZPixmap, NULL, shminfo, width, height);
+    if (img == NULL) {
+        coom_free(shminfo);
+        return NULL;
+    }
+
+    shminfo->shmid = shmget(IPC_PRIVATE, (usize)img->bytes_per_line * img->height, IPC_CREAT | 0600);
+    if (shminfo->shmid < 0) {
+        coom_warning("shmget failed - %s", strerror(errno));
+        goto error;
+    }
+    shminfo->shmaddr = img->data = shmat(shminfo->shmid, NULL, 0);
+    if (shminfo->shmaddr == (char *)-1) {
+        coom_warning("shmat failed - %s", strerror(errno));
+        shminfo->shmaddr = img->data = NULL;
+        goto error;
+    }
+    shminfo->readOnly     = False;
+
+    g_shm_display       = dpy;
+    g_shm_attach_failed = false;
+    g_shm_prev_handler  = XSetErrorHandler(coom_shm_error_handler);
+    XShmAttach(dpy, shminfo);
+    XSync(dpy, False);
+    XSetErrorHandler(g_shm_prev_handler);
+    g_shm_display = NULL;
+    if (g_shm_attach_failed) {
+        coom_warning("XShmAttach failed, display is probably remote");
+        goto error;
+    }
+    // the segment stays alive until the last detach, so nothing leaks if we crash later
+    shmctl(shminfo->shmid, IPC_RMID, NULL);
+    return img;
+
+error:
+    if (shminfo->shmaddr) shmdt(shminfo->shmaddr);
+    if (shminfo->shmid >= 0) shmctl(shminfo->shmid, IPC_RMID, NULL);
+    img->data = NULL;
+    XDestroyImage(img);  // also frees obdata (shminfo)
+    return NULL;
+}
+
+// MIT-SHM capture, the server writes the pixels straight into a shared segment instead of
+// streaming them through the socket. returns NULL when the extension is missing or unusable
+// (e.g. remote display), the caller then falls back to plain XGetImage
+static XImage *coom_new_screenshot_shm(Display *dpy, Window win, XWindowAttributes *attr, coom_rect area) {
+    XImage *img = coom_new_shm_image(dpy, attr->visual, attr->depth, area.w, area.h);
+    if (img == NULL) return NULL;
+    if (!XShmGetImage(dpy, win, img, area.x, area.y, AllPlanes)) {
+        coom_warning("XShmGetImage failed");
+        coom_delete_screenshot(dpy, img);
+        return NULL;
+    }
+    return img;
+}
+
+XImage *coom_new_screenshot(Display *dpy, Window win, coom_rect area) {
     coom_info("%s", __PRETTY_FUNCTION__);
     XWindowAttributes attr;
     XGetWindowAttributes(dpy, win, &attr);
-    XImage *img = XGetImage(dpy, win, 0, 0, attr.width, attr.height, AllPlanes, ZPixmap);
+
+    const char *backend = "XShmGetImage";
+    f64         start   = coom_time_now();
+    XImage     *img     = coom_new_screenshot_shm(dpy, win, &attr, area);
+    if (img == NULL) {
+        backend = "XGetImage";
+        img     = XGetImage(dpy, win, area.x, area.y, area.w, area.h, AllPlanes, ZPixmap);
+    }
     ASSERT_EXIT(img != NULL, 1, "Failed to get screenshot, exiting");
+    coom_info("captured %dx%d screenshot with %s in %.2f ms", img->width, img->height, backend, (coom_time_now() - start) * 1000.0);
+    return img;
+}
+
+XImage *coom_new_synthetic_screenshot(int width, int height) {
+    XImage *img = coom_alloc(NULL, sizeof(XImage));
+    *img        = (XImage){
+        .width            = width,
+        .height           = height,
+        .format           = ZPixmap,
+        .byte_order       = LSBFirst,
+        .bitmap_unit      = 32,
+        .bitmap_bit_order = LSBFirst,
+        .bitmap_pad       = 32,
+        .depth            = 24,
+        .bytes_per_line   = width * 4,
+        .bits_per_pixel   = 32,
+        .red_mask         = 0xff0000,
+        .green_mask       = 0x00ff00,
+        .blue_mask        = 0x0000ff,
+    };
+    img->data = coom_alloc(NULL, (usize)img->bytes_per_line * height);
+    ASSERT_EXIT(XInitImage(img) != 0, 1, "Failed to initialize synthetic image");
+    for (int y = 0; y < height; ++y) {
+        u32 *row = (u32 *)(img->data + (usize)y * img->bytes_per_line);
+        for (int x = 0; x < width; ++x) row[x] = ((x * 255 / width) << 16) | ((y * 255 / height) << 8) | (((x ^ y) & 0x20) ? 0xff : 0x00);
+    }
     return img;
 }
 
-void coom_delete_screenshot(XImage *img) {
+void coom_delete_screenshot(Display *dpy, XImage *img) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    if (img == NULL) return;
+    XShmSegmentInfo *shminfo = (XShmSegmentInfo *)img->obdata;
+    if (shminfo != NULL) {
+        coom_detach_screenshot(dpy, img);
+        shmdt(shminfo->shmaddr);
+        img->data = NULL;
+    }
+    XDestroyImage(img);
+}
+
+void coom_detach_screenshot(Display *dpy, XImage *img) {
+    XShmSegmentInfo *shminfo = (XShmSegmentInfo *)img->obdata;
+    if (dpy == NULL || shminfo == NULL || shminfo->shmseg == None) return;
+    XShmDetach(dpy, shminfo);
+    XSync(dpy, False);
+    shminfo->shmseg = None;
+}
+
+static void *coom_capture_worker(void *arg) {
+    coom_capture *cap = arg;
+    Display      *dpy = XOpenDisplay(NULL);
+    if (dpy == NULL) {
+        coom_warning("capture thread failed to open its own display");
+        return NULL;
+    }
+    cap->img = coom_new_screenshot(dpy, cap->target, cap->area);
+    // the pixels outlive this connection, only the server side of the segment goes away
+    coom_detach_screenshot(dpy, cap->img);
+    XCloseDisplay(dpy);
+    return NULL;
+}
+
+bool coom_capture_start(coom_capture *cap) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    cap->img     = NULL;
+    cap->running = pthread_create(&cap->thread, NULL, coom_capture_worker, cap) == 0;
+    if (!cap->running) coom_warning("failed to spawn capture thread - %s", strerror(errno));
+    return cap->running;
+}
+
+XImage *coom_capture_join(Display *dpy, coom_capture *cap) {
     coom_info("%s", __PRETTY_FUNCTION__);
-    if (img) XDestroyImage(img);
+    if (cap->running) pthread_join(cap->thread, NULL);
+    cap->running = false;
+    // no thread or no second connection, capture on the caller's one instead
+    if (cap->img == NULL) cap->img = coom_new_screenshot(dpy, cap->target, cap->area);
+    return cap->img;
 }
 
+#define COOM_PPM_BUFFER (1 << 20)
+
 bool coom_save_to_ppm(XImage *img, const char *file_path) {
     coom_info("%s", __PRETTY_FUNCTION__);
     if (img == NULL) return false;
@@ -208,18 +912,94 @@ bool coom_save_to_ppm(XImage *img, const char *file_path) {
         coom_error("failed to open file: '%s' - %s", file_path, strerror(errno));
         return false;
     }
+    coom_convert    convert;
+    coom_rgb_row_fn row = coom_rgb_row_converter(img, COOM_CONVERT_COUNT - 1, &convert);
+    coom_info("ppm: %s rows", coom_convert_name(convert));
+
+    // whole rows are converted into a buffer of about COOM_PPM_BUFFER bytes, one fwrite each
+    usize stride = (usize)img->width * 3;
+    usize rows   = COOM_PPM_BUFFER / stride > 0 ? COOM_PPM_BUFFER / stride : 1;
+    u8   *buffer = coom_alloc(NULL, rows * stride);
     fprintf(f, "P6\n%d %d\n255\n", img->width, img->height);
-    for (int y = 0; y < img->height; y++) {
-        for (int x = 0; x < img->width; x++) {
-            unsigned char color[3];
-            unsigned long pixel = XGetPixel(img, x, y);
-            color[2]            = pixel & img->blue_mask;
-            color[1]            = (pixel & img->green_mask) >> 8;
-            color[0]            = (pixel & img->red_mask) >> 16;
-            fwrite(color, 1, 3, f);
+    for (int y = 0; y < img->height && result; y += rows) {
+        usize n = (usize)img->height - y < rows ? (usize)img->height - y : rows;
+        for (usize i = 0; i < n; ++i) row(img, y + i, buffer + i * stride);
+        if (fwrite(buffer, stride, n, f) != n) {
+            coom_error("failed to write '%s' - %s", file_path, strerror(errno));
+            result = false;
         }
     }
+    coom_free(buffer);
 
-    if (f) fclose(f);
+    if (fclose(f) != 0 && result) {
+        coom_error("failed to write '%s' - %s", file_path, strerror(errno));
+        result = false;
+    }
     return result;
 }
+
+// bits of `mask` as an 8-bit channel, narrower channels are stretched to the full range
+static u32 coom_decode_channel(unsigned long pixel, unsigned long mask) {
+    if (mask == 0) return 0;
+    int shift = __builtin_ctzl(mask), bits = __builtin_popcountl(mask);
+    u32 value = (pixel & mask) >> shift;
+    if (bits >= 8) return value >> (bits - 8);
+    return value * 255 / ((1u << bits) - 1);
+}
+
+u32 coom_decode_pixel(const XImage *img, unsigned long pixel) {
+    return coom_decode_channel(pixel, img->red_mask) << 16 | coom_decode_channel(pixel, img->green_mask) << 8 | coom_decode_channel(pixel, img->blue_mask);
+}
+
+Damage coom_new_damage(Display *dpy, Drawable target, int *event_base) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    int error_base;
+    if (!XDamageQueryExtension(dpy, event_base, &error_base)) {
+        coom_error("XDamage extension is not available, live mode disabled");
+        return None;
+    }
+    // NonEmpty only notifies once until the damage is subtracted, so a busy screen does
+    // not flood the event queue between two frames
+    return XDamageCreate(dpy, target, XDamageReportNonEmpty);
+}
+
+void coom_delete_damage(Display *dpy, Damage damage) {
+    coom_info("%s", __PRETTY_FUNCTION__);
+    if (damage != None) XDamageDestroy(dpy, damage);
+}
+
+usize coom_refresh_damage(Display *dpy, Damage damage, Drawable target, coom_rect area, XImage *img, coom_texture *tex, coom_history *history) {
+    XserverRegion region = XFixesCreateRegion(dpy, NULL, 0);
+    XDamageSubtract(dpy, damage, None, region);
+
+    int         count  = 0;
+    usize       pixels = 0;
+    XRectangle *rects  = COOM_X_ROUND_TRIP(XFixesFetchRegion(dpy, region, &count));
+    int         bx0 = img->width, by0 = img->height, bx1 = 0, by1 = 0;
+    for (int i = 0; i < count; ++i) {
+        // damage comes in `target` coordinates, the image only covers `area`
+        int rx = rects[i].x - area.x, ry = rects[i].y - area.y;
+        int x0 = rx < 0 ? 0 : rx;
+        int y0 = ry < 0 ? 0 : ry;
+        int x1 = rx + rects[i].width > img->width ? img->width : rx + rects[i].width;
+        int y1 = ry + rects[i].height > img->height ? img->height : ry + rects[i].height;
+        if (x1 <= x0 || y1 <= y0) x0 = y0 = x1 = y1 = 0;
+        rects[i] = (XRectangle){.x = x0, .y = y0, .width = x1 - x0, .height = y1 - y0};
+        if (x1 <= x0 || y1 <= y0) continue;
+        bx0 = x0 < bx0 ? x0 : bx0, by0 = y0 < by0 ? y0 : by0;
+        bx1 = x1 > bx1 ? x1 : bx1, by1 = y1 > by1 ? y1 : by1;
+    }
+    if (history && bx1 > bx0) coom_history_begin(history, img, (coom_rect){.x = bx0, .y = by0, .w = bx1 - bx0, .h = by1 - by0});
+
+    for (int i = 0; i < count; ++i) {
+        XRectangle r = rects[i];
+        if (r.width == 0 || r.height == 0) continue;
+        COOM_X_ROUND_TRIP(XGetSubImage(dpy, target, area.x + r.x, area.y + r.y, r.width, r.height, AllPlanes, ZPixmap, img, r.x, r.y));
+        if (history == NULL || history->cursor == 0) coom_update_texture(tex, img, r.x, r.y, r.width, r.height);
+        pixels += (usize)r.width * r.height;
+    }
+    if (history && bx1 > bx0) coom_history_commit(history, img);
+    if (rects) XFree(rects);
+    XFixesDestroyRegion(dpy, region);
+    return pixels;
+}